@@ -20,10 +20,14 @@
 #include <memory>
 #include "LBM.h"
 
-#include <fstream>
+#include <cerrno>
+#include <stdexcept>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
 using namespace std;
 
-void LBM::taylor_green(unsigned int t, unsigned int x, unsigned int y,mdspan<double, dextents<size_t, 2>> r,mdspan<double, dextents<size_t, 2>> u,mdspan<double, dextents<size_t, 2>> v)
+void LBM::taylor_green(unsigned int t, size_t x, size_t y,mdspan<double, dextents<size_t, 2>> r,mdspan<double, dextents<size_t, 2>> u,mdspan<double, dextents<size_t, 2>> v)
 {
     double kx = 2.0*M_PI/NX;
     double ky = 2.0*M_PI/NY;
@@ -43,9 +47,9 @@ void LBM::taylor_green(unsigned int t, unsigned int x, unsigned int y,mdspan<dou
 
 void LBM::taylor_green(unsigned int t, mdspan<double, dextents<size_t, 2>> r,mdspan<double, dextents<size_t, 2>> u,mdspan<double, dextents<size_t, 2>> v)
 {
-    for(unsigned int y = 0; y < NY; ++y)
+    for(size_t y = 0; y < NY; ++y)
     {
-        for(unsigned int x = 0; x < NX; ++x)
+        for(size_t x = 0; x < NX; ++x)
         {
             size_t sidx = scalar_index(x,y);
 //TODO slice arrays
@@ -53,7 +57,7 @@ void LBM::taylor_green(unsigned int t, mdspan<double, dextents<size_t, 2>> r,mds
         }
     }
 }
-void LBM::taylor_green_cfp(unsigned int t, unsigned int x, unsigned int y, double *r, double *u, double *v)
+void LBM::taylor_green_cfp(unsigned int t, size_t x, size_t y, double *r, double *u, double *v)
 {
     double kx = 2.0*M_PI/NX;
     double ky = 2.0*M_PI/NY;
@@ -70,139 +74,650 @@ void LBM::taylor_green_cfp(unsigned int t, unsigned int x, unsigned int y, doubl
     *u = ux;
     *v = uy;
 }
+// equilibrium populations of node (x,y) for the moments rho, ux, uy
+void LBM::equilibrium_node(size_t x, size_t y, double rho, double ux, double uy, mdspan<double, dextents<size_t, 2>> f0,mdspan<double, dextents<size_t, 3>> f1)
+{
+    // load equilibrium
+    // feq_i  = w_i rho [1 + 3(ci . u) + (9/2) (ci . u)^2 - (3/2) (u.u)]
+    // feq_i  = w_i rho [1 - 3/2 (u.u) + (ci . 3u) + (1/2) (ci . 3u)^2]
+    // feq_i  = w_i rho [1 - 3/2 (u.u) + (ci . 3u){ 1 + (1/2) (ci . 3u) }]
+    
+    // temporary variables
+    double w0r = w0*rho;
+    double wsr = ws*rho;
+    double wdr = wd*rho;
+    double omusq = 1.0 - 1.5*(ux*ux+uy*uy);
+    
+    double tux = 3.0*ux;
+    double tuy = 3.0*uy;
+    
+    f0[x,y]    = w0r*(omusq);
+    
+    double cidot3u = tux;
+    f1[x,y,0]  = wsr*(omusq + cidot3u*(1.0+0.5*cidot3u));
+    cidot3u = tuy;
+    f1[x,y,1]  = wsr*(omusq + cidot3u*(1.0+0.5*cidot3u));
+    cidot3u = -tux;
+    f1[x,y,2]  = wsr*(omusq + cidot3u*(1.0+0.5*cidot3u));
+    cidot3u = -tuy;
+    f1[x,y,3]  = wsr*(omusq + cidot3u*(1.0+0.5*cidot3u));
+    
+    cidot3u = tux+tuy;
+    f1[x,y,4]  = wdr*(omusq + cidot3u*(1.0+0.5*cidot3u));
+    cidot3u = tuy-tux;
+    f1[x,y,5]  = wdr*(omusq + cidot3u*(1.0+0.5*cidot3u));
+    cidot3u = -(tux+tuy);
+    f1[x,y,6]  = wdr*(omusq + cidot3u*(1.0+0.5*cidot3u));
+    cidot3u = tux-tuy;
+    f1[x,y,7]  = wdr*(omusq + cidot3u*(1.0+0.5*cidot3u));
+}
+
 void LBM::init_equilibrium(mdspan<double, dextents<size_t, 2>> f0,mdspan<double, dextents<size_t, 3>> f1, mdspan<double, dextents<size_t, 2>> r,mdspan<double, dextents<size_t, 2>> u,mdspan<double, dextents<size_t, 2>> v)
 {
-    for(unsigned int y = 0; y < NY; ++y)
+    for(size_t y = 0; y < NY; ++y)
     {
-        for(unsigned int x = 0; x < NX; ++x)
+        for(size_t x = 0; x < NX; ++x)
         {
-            double rho = r[x,y];
-            double ux  = u[x,y];
-            double uy  = v[x,y];
-            
-            // load equilibrium
-            // feq_i  = w_i rho [1 + 3(ci . u) + (9/2) (ci . u)^2 - (3/2) (u.u)]
-            // feq_i  = w_i rho [1 - 3/2 (u.u) + (ci . 3u) + (1/2) (ci . 3u)^2]
-            // feq_i  = w_i rho [1 - 3/2 (u.u) + (ci . 3u){ 1 + (1/2) (ci . 3u) }]
-            
-            // temporary variables
-            double w0r = w0*rho;
-            double wsr = ws*rho;
-            double wdr = wd*rho;
-            double omusq = 1.0 - 1.5*(ux*ux+uy*uy);
+            equilibrium_node(x,y,r[x,y],u[x,y],v[x,y],f0,f1);
+        }
+    }
+}
+
+void LBM::stream_collide_save(mdspan<double, dextents<size_t, 2>> f0, mdspan<double, dextents<size_t, 3>> f1, mdspan<double, dextents<size_t, 3>> f2, mdspan<double, dextents<size_t, 2>> r, mdspan<double, dextents<size_t, 2>> u, mdspan<double, dextents<size_t, 2>> v, bool save)
+{
+    stream_collide_save(f0,f1,f2,r,u,v,save,0,NY,nullptr,nullptr);
+}
+
+// BGK collision of the populations ft of node (x,y); stores the moments if
+// save, feeds the watchdog bounds if given, and stores the post-collision
+// populations, with the thermal noise if given, in fc; shared by both
+// streaming schemes.
+// The node routines are forced inline: with several traversals calling
+// them GCC stops inlining, and ft/fc then go through memory
+__attribute__((always_inline)) inline void LBM::collide_node(size_t x, size_t y, const double *ft, double *fc, mdspan<double, dextents<size_t, 2>> r, mdspan<double, dextents<size_t, 2>> u, mdspan<double, dextents<size_t, 2>> v, bool save, FlowBounds *bounds, const Noise *noise, double tauinv, double omtauinv)
+{
+    // compute moments
+    double rho = ft[0]+ft[1]+ft[2]+ft[3]+ft[4]+ft[5]+ft[6]+ft[7]+ft[8];
+    double rhoinv = 1.0/rho;
+    
+    double ux = rhoinv*(ft[1]+ft[5]+ft[8]-(ft[3]+ft[6]+ft[7]));
+    double uy = rhoinv*(ft[2]+ft[5]+ft[6]-(ft[4]+ft[7]+ft[8]));
+    
+    // only write to memory when needed
+    if(save)
+    {
+        r[x,y] = rho;
+        u[x,y] = ux;
+        v[x,y] = uy;
+    }
+    
+    if(bounds != nullptr)
+        bounds->add(rho,ux*ux+uy*uy,watchdogRhoMin,watchdogUMax*watchdogUMax);
+    
+    // now compute and relax to equilibrium
+    // note that
+    // feq_i  = w_i rho [1 + 3(ci . u) + (9/2) (ci . u)^2 - (3/2) (u.u)]
+    // feq_i  = w_i rho [1 - 3/2 (u.u) + (ci . 3u) + (1/2) (ci . 3u)^2]
+    // feq_i  = w_i rho [1 - 3/2 (u.u) + (ci . 3u){ 1 + (1/2) (ci . 3u) }]
+    
+    // temporary variables
+    double tw0r = tauinv*w0*rho; //   w[0]*rho/tau 
+    double twsr = tauinv*ws*rho; // w[1-4]*rho/tau
+    double twdr = tauinv*wd*rho; // w[5-8]*rho/tau
+    double omusq = 1.0 - 1.5*(ux*ux+uy*uy); // 1-(3/2)u.u
+    
+    double tux = 3.0*ux;
+    double tuy = 3.0*uy;
+    
+    
+    fc[0] = omtauinv*ft[0] + tw0r*(omusq);
+    
+    double cidot3u = tux;
+    fc[1] = omtauinv*ft[1] + twsr*(omusq + cidot3u*(1.0+0.5*cidot3u));
+    cidot3u = tuy;
+    fc[2] = omtauinv*ft[2] + twsr*(omusq + cidot3u*(1.0+0.5*cidot3u));
+    cidot3u = -tux;
+    fc[3] = omtauinv*ft[3] + twsr*(omusq + cidot3u*(1.0+0.5*cidot3u));
+    cidot3u = -tuy;
+    fc[4] = omtauinv*ft[4] + twsr*(omusq + cidot3u*(1.0+0.5*cidot3u));
+    
+    cidot3u = tux+tuy;
+    fc[5] = omtauinv*ft[5] + twdr*(omusq + cidot3u*(1.0+0.5*cidot3u));
+    cidot3u = tuy-tux;
+    fc[6] = omtauinv*ft[6] + twdr*(omusq + cidot3u*(1.0+0.5*cidot3u));
+    cidot3u = -(tux+tuy);
+    fc[7] = omtauinv*ft[7] + twdr*(omusq + cidot3u*(1.0+0.5*cidot3u));
+    cidot3u = tux-tuy;
+    fc[8] = omtauinv*ft[8] + twdr*(omusq + cidot3u*(1.0+0.5*cidot3u));
+    
+    if(noise != nullptr)
+        noise->apply(x,y,rho,fc);
+}
+
+// pull: gather the populations of node (x,y) from the neighbours in f1,
+// collide and store them locally to f2; shared by all traversal orders.
+// With walls, solid nodes are skipped and keep their populations, and a
+// population that would come from a solid node is the opposite one of this
+// node, reflected at the wall halfway in the previous step (halfway
+// bounce-back)
+template<bool walls>
+__attribute__((always_inline)) inline void LBM::stream_collide_node(size_t x, size_t y, mdspan<double, dextents<size_t, 2>> f0, mdspan<double, dextents<size_t, 3>> f1, mdspan<double, dextents<size_t, 3>> f2, mdspan<double, dextents<size_t, 2>> r, mdspan<double, dextents<size_t, 2>> u, mdspan<double, dextents<size_t, 2>> v, bool save, FlowBounds *bounds, const Noise *noise, double tauinv, double omtauinv)
+{
+    size_t xp1 = (x+1)%NX;
+    size_t yp1 = (y+1)%NY;
+    size_t xm1 = (NX+x-1)%NX;
+    size_t ym1 = (NY+y-1)%NY;
+    
+    // direction numbering scheme
+    // 6 2 5
+    // 3 0 1
+    // 7 4 8
+    
+    if constexpr(walls)
+    {
+        if(solid[x,y])
+            return;
+    }
+    
+    double ft[9], fc[9];
+    ft[0] = f0[x,y];
+    
+    // load populations from adjacent nodes
+    ft[1] = f1[xm1,y,  0];
+    ft[2] = f1[x,  ym1,1];
+    ft[3] = f1[xp1,y,  2];
+    ft[4] = f1[x,  yp1,3];
+    ft[5] = f1[xm1,ym1,4];
+    ft[6] = f1[xp1,ym1,5];
+    ft[7] = f1[xp1,yp1,6];
+    ft[8] = f1[xm1,yp1,7];
+    
+    if constexpr(walls)
+    {
+        if(solid[xm1,y  ]) ft[1] = f1[x,y,2];
+        if(solid[x,  ym1]) ft[2] = f1[x,y,3];
+        if(solid[xp1,y  ]) ft[3] = f1[x,y,0];
+        if(solid[x,  yp1]) ft[4] = f1[x,y,1];
+        if(solid[xm1,ym1]) ft[5] = f1[x,y,6];
+        if(solid[xp1,ym1]) ft[6] = f1[x,y,7];
+        if(solid[xp1,yp1]) ft[7] = f1[x,y,4];
+        if(solid[xm1,yp1]) ft[8] = f1[x,y,5];
+    }
+    
+    collide_node(x,y,ft,fc,r,u,v,save,bounds,noise,tauinv,omtauinv);
+    
+    f0[x,y]   = fc[0];
+    f2[x,y,0] = fc[1];
+    f2[x,y,1] = fc[2];
+    f2[x,y,2] = fc[3];
+    f2[x,y,3] = fc[4];
+    f2[x,y,4] = fc[5];
+    f2[x,y,5] = fc[6];
+    f2[x,y,6] = fc[7];
+    f2[x,y,7] = fc[8];
+}
+
+// push: load the populations of node (x,y) from f1, collide and scatter them
+// to the neighbours in f2; f1 must hold populations that have already been
+// streamed, see stream_only. With walls, solid nodes are skipped and a
+// population sent into a solid node comes back to this node reversed
+template<bool walls>
+__attribute__((always_inline)) inline void LBM::collide_stream_node(size_t x, size_t y, mdspan<double, dextents<size_t, 2>> f0, mdspan<double, dextents<size_t, 3>> f1, mdspan<double, dextents<size_t, 3>> f2, mdspan<double, dextents<size_t, 2>> r, mdspan<double, dextents<size_t, 2>> u, mdspan<double, dextents<size_t, 2>> v, bool save, FlowBounds *bounds, const Noise *noise, double tauinv, double omtauinv)
+{
+    size_t xp1 = (x+1)%NX;
+    size_t yp1 = (y+1)%NY;
+    size_t xm1 = (NX+x-1)%NX;
+    size_t ym1 = (NY+y-1)%NY;
+    
+    if constexpr(walls)
+    {
+        if(solid[x,y])
+            return;
+    }
+    
+    double ft[9], fc[9];
+    ft[0] = f0[x,y];
+    ft[1] = f1[x,y,0];
+    ft[2] = f1[x,y,1];
+    ft[3] = f1[x,y,2];
+    ft[4] = f1[x,y,3];
+    ft[5] = f1[x,y,4];
+    ft[6] = f1[x,y,5];
+    ft[7] = f1[x,y,6];
+    ft[8] = f1[x,y,7];
+    
+    collide_node(x,y,ft,fc,r,u,v,save,bounds,noise,tauinv,omtauinv);
+    
+    // store populations to adjacent nodes
+    f0[x,y]         = fc[0];
+    if constexpr(walls)
+    {
+        (solid[xp1,y  ] ? f2[x,y,2] : f2[xp1,y,  0]) = fc[1];
+        (solid[x,  yp1] ? f2[x,y,3] : f2[x,  yp1,1]) = fc[2];
+        (solid[xm1,y  ] ? f2[x,y,0] : f2[xm1,y,  2]) = fc[3];
+        (solid[x,  ym1] ? f2[x,y,1] : f2[x,  ym1,3]) = fc[4];
+        (solid[xp1,yp1] ? f2[x,y,6] : f2[xp1,yp1,4]) = fc[5];
+        (solid[xm1,yp1] ? f2[x,y,7] : f2[xm1,yp1,5]) = fc[6];
+        (solid[xm1,ym1] ? f2[x,y,4] : f2[xm1,ym1,6]) = fc[7];
+        (solid[xp1,ym1] ? f2[x,y,5] : f2[xp1,ym1,7]) = fc[8];
+        return;
+    }
+    f2[xp1,y,  0]   = fc[1];
+    f2[x,  yp1,1]   = fc[2];
+    f2[xm1,y,  2]   = fc[3];
+    f2[x,  ym1,3]   = fc[4];
+    f2[xp1,yp1,4]   = fc[5];
+    f2[xm1,yp1,5]   = fc[6];
+    f2[xm1,ym1,6]   = fc[7];
+    f2[xp1,ym1,7]   = fc[8];
+}
+
+// stream f1 to f2 without collision for the rows ybegin <= y < yend; turns
+// the populations of init_equilibrium into the input of the push kernel
+void LBM::stream_only(mdspan<double, dextents<size_t, 3>> f1, mdspan<double, dextents<size_t, 3>> f2, size_t ybegin, size_t yend)
+{
+    const bool walls = solid.data_handle() != nullptr;
+    for(size_t y = ybegin; y < yend; ++y)
+    {
+        for(size_t x = 0; x < NX; ++x)
+        {
+            size_t xp1 = (x+1)%NX;
+            size_t yp1 = (y+1)%NY;
+            size_t xm1 = (NX+x-1)%NX;
+            size_t ym1 = (NY+y-1)%NY;
             
-            double tux = 3.0*ux;
-            double tuy = 3.0*uy;
+            // solid nodes keep their populations; across a wall slot d is
+            // the opposite slot o of this node
+            if(walls && solid[x,y])
+            {
+                for(unsigned int d = 0; d < ndir-1; ++d)
+                    f2[x,y,d] = f1[x,y,d];
+                continue;
+            }
+            auto from = [&](size_t xs, size_t ys, unsigned int d, unsigned int o)
+            {
+                return walls && solid[xs,ys] ? f1[x,y,o] : f1[xs,ys,d];
+            };
             
-            f0[x,y]    = w0r*(omusq);
+            f2[x,y,0] = from(xm1,y,  0,2);
+            f2[x,y,1] = from(x,  ym1,1,3);
+            f2[x,y,2] = from(xp1,y,  2,0);
+            f2[x,y,3] = from(x,  yp1,3,1);
+            f2[x,y,4] = from(xm1,ym1,4,6);
+            f2[x,y,5] = from(xp1,ym1,5,7);
+            f2[x,y,6] = from(xp1,yp1,6,4);
+            f2[x,y,7] = from(xm1,yp1,7,5);
+        }
+    }
+}
+
+// inverse of stream_only: move the populations back to the nodes they came
+// from, e.g. to restart a push checkpoint with pull streaming
+void LBM::stream_back(mdspan<double, dextents<size_t, 3>> f1, mdspan<double, dextents<size_t, 3>> f2, size_t ybegin, size_t yend)
+{
+    const bool walls = solid.data_handle() != nullptr;
+    for(size_t y = ybegin; y < yend; ++y)
+    {
+        for(size_t x = 0; x < NX; ++x)
+        {
+            size_t xp1 = (x+1)%NX;
+            size_t yp1 = (y+1)%NY;
+            size_t xm1 = (NX+x-1)%NX;
+            size_t ym1 = (NY+y-1)%NY;
             
-            double cidot3u = tux;
-            f1[x,y,1]  = wsr*(omusq + cidot3u*(1.0+0.5*cidot3u));
-            cidot3u = tuy;
-            f1[x,y,2]  = wsr*(omusq + cidot3u*(1.0+0.5*cidot3u));
-            cidot3u = -tux;
-            f1[x,y,3]  = wsr*(omusq + cidot3u*(1.0+0.5*cidot3u));
-            cidot3u = -tuy;
-            f1[x,y,4]  = wsr*(omusq + cidot3u*(1.0+0.5*cidot3u));
+            // solid nodes keep their populations; across a wall slot d is
+            // the opposite slot o of this node
+            if(walls && solid[x,y])
+            {
+                for(unsigned int d = 0; d < ndir-1; ++d)
+                    f2[x,y,d] = f1[x,y,d];
+                continue;
+            }
+            auto from = [&](size_t xs, size_t ys, unsigned int d, unsigned int o)
+            {
+                return walls && solid[xs,ys] ? f1[x,y,o] : f1[xs,ys,d];
+            };
             
-            cidot3u = tux+tuy;
-            f1[x,y,5]  = wdr*(omusq + cidot3u*(1.0+0.5*cidot3u));
-            cidot3u = tuy-tux;
-            f1[x,y,6]  = wdr*(omusq + cidot3u*(1.0+0.5*cidot3u));
-            cidot3u = -(tux+tuy);
-            f1[x,y,7]  = wdr*(omusq + cidot3u*(1.0+0.5*cidot3u));
-            cidot3u = tux-tuy;
-            f1[x,y,8]  = wdr*(omusq + cidot3u*(1.0+0.5*cidot3u));
+            f2[x,y,0] = from(xp1,y,  0,2);
+            f2[x,y,1] = from(x,  yp1,1,3);
+            f2[x,y,2] = from(xm1,y,  2,0);
+            f2[x,y,3] = from(x,  ym1,3,1);
+            f2[x,y,4] = from(xp1,yp1,4,6);
+            f2[x,y,5] = from(xm1,yp1,5,7);
+            f2[x,y,6] = from(xm1,ym1,6,4);
+            f2[x,y,7] = from(xp1,ym1,7,5);
         }
     }
 }
 
-void LBM::stream_collide_save(mdspan<double, dextents<size_t, 2>> f0, mdspan<double, dextents<size_t, 3>> f1, mdspan<double, dextents<size_t, 3>> f2, mdspan<double, dextents<size_t, 2>> r, mdspan<double, dextents<size_t, 2>> u, mdspan<double, dextents<size_t, 2>> v, bool save)
+// update the rows ybegin <= y < yend only; the rows of different calls may
+// be processed concurrently since every population is written by exactly one
+// node
+void LBM::stream_collide_save(mdspan<double, dextents<size_t, 2>> f0, mdspan<double, dextents<size_t, 3>> f1, mdspan<double, dextents<size_t, 3>> f2, mdspan<double, dextents<size_t, 2>> r, mdspan<double, dextents<size_t, 2>> u, mdspan<double, dextents<size_t, 2>> v, bool save, size_t ybegin, size_t yend, FlowBounds *bounds, const Noise *noise)
 {
     // useful constants
     const double tauinv = 2.0/(6.0*nu+1.0); // 1/tau
     const double omtauinv = 1.0-tauinv;     // 1 - 1/tau
 
-    for(unsigned int y = 0; y < NY; ++y)
+    // the traversal is written once for both streaming schemes
+    auto traverse = [&](auto node)
     {
-        for(unsigned int x = 0; x < NX; ++x)
+        if(traversal == Traversal::Sweep)
         {
-            unsigned int xp1 = (x+1)%NX;
-            unsigned int yp1 = (y+1)%NY;
-            unsigned int xm1 = (NX+x-1)%NX;
-            unsigned int ym1 = (NY+y-1)%NY;
-            
-            // direction numbering scheme
-            // 6 2 5
-            // 3 0 1
-            // 7 4 8
-            
-            double ft0 = f0[x,y];
-            
-            // load populations from adjacent nodes
-            double ft1 = f1[xm1,y,  1];
-            double ft2 = f1[x,  ym1,2];
-            double ft3 = f1[xp1,y,  3];
-            double ft4 = f1[x,  yp1,4];
-            double ft5 = f1[xm1,ym1,5];
-            double ft6 = f1[xp1,ym1,6];
-            double ft7 = f1[xp1,yp1,7];
-            double ft8 = f1[xm1,yp1,8];
-            
-            // compute moments
-            double rho = ft0+ft1+ft2+ft3+ft4+ft5+ft6+ft7+ft8;
-            double rhoinv = 1.0/rho;
-            
-            double ux = rhoinv*(ft1+ft5+ft8-(ft3+ft6+ft7));
-            double uy = rhoinv*(ft2+ft5+ft6-(ft4+ft7+ft8));
-            
-            // only write to memory when needed
-            if(save)
+            for(size_t y = ybegin; y < yend; ++y)
             {
-                r[x,y] = rho;
-                u[x,y] = ux;
-                v[x,y] = uy;
+                for(size_t x = 0; x < NX; ++x)
+                {
+                    node(x,y);
+                }
             }
-            
-            // now compute and relax to equilibrium
-            // note that
-            // feq_i  = w_i rho [1 + 3(ci . u) + (9/2) (ci . u)^2 - (3/2) (u.u)]
-            // feq_i  = w_i rho [1 - 3/2 (u.u) + (ci . 3u) + (1/2) (ci . 3u)^2]
-            // feq_i  = w_i rho [1 - 3/2 (u.u) + (ci . 3u){ 1 + (1/2) (ci . 3u) }]
-            
-            // temporary variables
-            double tw0r = tauinv*w0*rho; //   w[0]*rho/tau 
-            double twsr = tauinv*ws*rho; // w[1-4]*rho/tau
-            double twdr = tauinv*wd*rho; // w[5-8]*rho/tau
-            double omusq = 1.0 - 1.5*(ux*ux+uy*uy); // 1-(3/2)u.u
-            
-            double tux = 3.0*ux;
-            double tuy = 3.0*uy;
-            
-            
-            f0[x,y]    = omtauinv*ft0  + tw0r*(omusq);
-            
-            double cidot3u = tux;
-            f2[x,y,1]  = omtauinv*ft1  + twsr*(omusq + cidot3u*(1.0+0.5*cidot3u));
-            cidot3u = tuy;
-            f2[x,y,2]  = omtauinv*ft2  + twsr*(omusq + cidot3u*(1.0+0.5*cidot3u));
-            cidot3u = -tux;
-            f2[x,y,3]  = omtauinv*ft3  + twsr*(omusq + cidot3u*(1.0+0.5*cidot3u));
-            cidot3u = -tuy;
-            f2[x,y,4]  = omtauinv*ft4  + twsr*(omusq + cidot3u*(1.0+0.5*cidot3u));
-            
-            cidot3u = tux+tuy;
-            f2[x,y,5]  = omtauinv*ft5  + twdr*(omusq + cidot3u*(1.0+0.5*cidot3u));
-            cidot3u = tuy-tux;
-            f2[x,y,6]  = omtauinv*ft6  + twdr*(omusq + cidot3u*(1.0+0.5*cidot3u));
-            cidot3u = -(tux+tuy);
-            f2[x,y,7]  = omtauinv*ft7  + twdr*(omusq + cidot3u*(1.0+0.5*cidot3u));
-            cidot3u = tux-tuy;
-            f2[x,y,8]  = omtauinv*ft8  + twdr*(omusq + cidot3u*(1.0+0.5*cidot3u));
+            return;
+        }
+
+        // cache-blocked traversal: tiles of tile_nx x tile_ny nodes, inside a
+        // tile the inner loop runs along the index with unit stride so that the
+        // neighbouring lines are still cached when they are needed again
+        const bool y_inner = &f1[0,1,0] - &f1[0,0,0] < &f1[1,0,0] - &f1[0,0,0];
+        for(size_t y0 = ybegin; y0 < yend; y0 += tile_ny)
+        {
+            const size_t y1 = min(y0+tile_ny,yend);
+            for(size_t x0 = 0; x0 < NX; x0 += tile_nx)
+            {
+                const size_t x1 = min(x0+tile_nx,NX);
+                if(y_inner)
+                {
+                    for(size_t x = x0; x < x1; ++x)
+                        for(size_t y = y0; y < y1; ++y)
+                            node(x,y);
+                }
+                else
+                {
+                    for(size_t y = y0; y < y1; ++y)
+                        for(size_t x = x0; x < x1; ++x)
+                            node(x,y);
+                }
+            }
+        }
+    };
+
+    // the node routines without walls are instantiated separately, so a run
+    // without a solid mask does not pay for the bounce-back
+    auto nodes = [&](auto walls)
+    {
+        if(streaming == Streaming::Push)
+            traverse([&](size_t x, size_t y) { collide_stream_node<decltype(walls)::value>(x,y,f0,f1,f2,r,u,v,save,bounds,noise,tauinv,omtauinv); });
+        else
+            traverse([&](size_t x, size_t y) { stream_collide_node<decltype(walls)::value>(x,y,f0,f1,f2,r,u,v,save,bounds,noise,tauinv,omtauinv); });
+    };
+    if(solid.data_handle() != nullptr)
+        nodes(true_type{});
+    else
+        nodes(false_type{});
+}
+
+// advance nsteps time steps from f1 with the selected traversal and streaming
+// scheme, storing the moments of the last step if save and tracking its
+// watchdog bounds if watch; the populations end up in f1 for an even nsteps
+// and in f2 for an odd one
+void LBM::advance(mdspan<double, dextents<size_t, 2>> f0, mdspan<double, dextents<size_t, 3>> f1, mdspan<double, dextents<size_t, 3>> f2, mdspan<double, dextents<size_t, 2>> r, mdspan<double, dextents<size_t, 2>> u, mdspan<double, dextents<size_t, 2>> v, unsigned int nsteps, bool save, bool watch)
+{
+    if(watch)
+    {
+        for(FlowBounds &b : watch_bounds)
+            b.reset();
+    }
+    if(traversal == Traversal::Trapezoid)
+    {
+        stream_collide_trapezoid(f0,f1,f2,r,u,v,nsteps,save,watch);
+    }
+    else if(traversal == Traversal::Wavefront)
+    {
+        stream_collide_wavefront(f0,f1,f2,r,u,v,nsteps,save,watch);
+    }
+    else
+    {
+        const JitKernel::Fn kernel = jit && streaming == Streaming::Pull ? jit_kernel.get() : nullptr;
+        for(unsigned int s = 0; s < nsteps; ++s)
+        {
+            // one pool phase per step, every thread updates its slab of rows
+            const bool last = s+1 == nsteps;
+            const Noise step_noise = noise(time_step+s);
+            pool.run([&](unsigned int tid)
+            {
+                FlowBounds *bounds = watch && last ? &watch_bounds[tid] : nullptr;
+                if(kernel != nullptr)
+                    kernel(f0.data_handle(),f1.data_handle(),f2.data_handle(),r.data_handle(),u.data_handle(),v.data_handle(),save && last,bounds,pool.begin(tid,NY),pool.end(tid,NY));
+                else
+                    stream_collide_save(f0,f1,f2,r,u,v,save && last,pool.begin(tid,NY),pool.end(tid,NY),bounds,kT > 0.0 ? &step_noise : nullptr);
+            });
+            swap(f1,f2);
         }
     }
+    time_step += nsteps;
+}
+
+// thermal noise of the given step
+Noise LBM::noise(unsigned int step) const
+{
+    const double gamma = 1.0-2.0/(6.0*nu+1.0);
+    return Noise{{uint32_t(noiseSeed),uint32_t(noiseSeed >> 32)},step,3.0*kT*(1.0-gamma*gamma)};
+}
+
+// compile or load the specialised kernel if jit is set; falls back to the
+// built-in kernels when it is not available
+void LBM::prepare_jit()
+{
+    if(!jit || jit_kernel.get() != nullptr)
+        return;
+    if(streaming != Streaming::Pull || temporal() || kT > 0.0 || initial.masked())
+    {
+        logger.info("Warning: the JIT kernel supports pull streaming with the sweep and tiled traversals, without noise or solids, only");
+        jit = false;
+        return;
+    }
+    const double tauinv = 2.0/(6.0*nu+1.0);
+    // a sweep is a single tile per slab
+    const bool tiled = traversal == Traversal::Tiled;
+    if(!jit_kernel.load({NX,NY,tiled ? tile_nx : NX,tiled ? tile_ny : NY,tauinv,1.0-tauinv,w0,ws,wd,watchdogRhoMin,watchdogUMax*watchdogUMax},jitCacheDir,logger))
+        jit = false;
+}
+
+// bring the populations written by init_equilibrium into the form the
+// selected streaming scheme expects; may swap f1 and f2
+void LBM::prepare_streaming(mdspan<double, dextents<size_t, 3>> &f1, mdspan<double, dextents<size_t, 3>> &f2)
+{
+    if(streaming != Streaming::Push)
+        return;
+    pool.run([&](unsigned int tid)
+    {
+        stream_only(f1,f2,pool.begin(tid,NY),pool.end(tid,NY));
+    });
+    swap(f1,f2);
+}
+
+// Frigo-Strumpen walk of a space-time trapezoid: cut it in space while it is
+// wide enough, otherwise cut it in time; the pieces are visited in dependency
+// order so reuse adapts to every cache level without tuned sizes
+void LBM::walk(const Zoid &z, const SpaceTime &st, FlowBounds *bounds)
+{
+    const ptrdiff_t dt = z.t1-z.t0;
+    if(dt <= 0)
+        return;
+
+    // space cut: a leftmost zoid with a right edge sloping inwards and a
+    // remainder that depends on it (ds = 1 for the one node stencil radius)
+    for(int d = 0; d < 2; ++d)
+    {
+        const ptrdiff_t w2 = 2*(z.x1[d]-z.x0[d])+(z.dx1[d]-z.dx0[d])*dt; // twice the mid-height width
+        if(w2 >= 4*dt && w2 >= 4*zoid_min_width)
+        {
+            const ptrdiff_t xm = (2*(z.x0[d]+z.x1[d])+(2+z.dx0[d]+z.dx1[d])*dt)/4;
+            Zoid left = z, right = z;
+            left.x1[d] = xm;
+            left.dx1[d] = -1;
+            right.x0[d] = xm;
+            right.dx0[d] = -1;
+            walk(left,st,bounds);
+            walk(right,st,bounds);
+            return;
+        }
+    }
+
+    // time cut
+    if(dt > 1)
+    {
+        const unsigned int s = dt/2;
+        Zoid lower = z, upper = z;
+        lower.t1 = z.t0+s;
+        upper.t0 = z.t0+s;
+        for(int d = 0; d < 2; ++d)
+        {
+            upper.x0[d] = z.x0[d]+z.dx0[d]*s;
+            upper.x1[d] = z.x1[d]+z.dx1[d]*s;
+        }
+        walk(lower,st,bounds);
+        walk(upper,st,bounds);
+        return;
+    }
+
+    step_box(z.t0,z.x0[0],z.x1[0],z.x0[1],z.x1[1],st,bounds);
+}
+
+// step t of a multi-step traversal over the box x0 <= i < x1, y0 <= j < y1;
+// coordinates lie in [0,2N) and are wrapped periodically
+void LBM::step_box(unsigned int t, ptrdiff_t x0, ptrdiff_t x1, ptrdiff_t y0, ptrdiff_t y1, const SpaceTime &st, FlowBounds *watch)
+{
+    const bool save = t == st.save_step;
+    FlowBounds *const bounds = t == st.watch_step ? watch : nullptr;
+    Noise step_noise;
+    const Noise *noise = nullptr;
+    if(st.noise != nullptr)
+    {
+        step_noise = *st.noise;
+        step_noise.step += t;
+        noise = &step_noise;
+    }
+    const auto src = st.f[t%2];
+    const auto dst = st.f[(t+1)%2];
+    auto wrap = [](ptrdiff_t i, size_t n) { return size_t(i) >= n ? size_t(i)-n : size_t(i); };
+    auto box = [&](auto walls)
+    {
+        if(st.y_inner)
+        {
+            for(ptrdiff_t i = x0; i < x1; ++i)
+                for(ptrdiff_t j = y0; j < y1; ++j)
+                    stream_collide_node<decltype(walls)::value>(wrap(i,NX),wrap(j,NY),st.f0,src,dst,st.r,st.u,st.v,save,bounds,noise,st.tauinv,st.omtauinv);
+        }
+        else
+        {
+            for(ptrdiff_t j = y0; j < y1; ++j)
+                for(ptrdiff_t i = x0; i < x1; ++i)
+                    stream_collide_node<decltype(walls)::value>(wrap(i,NX),wrap(j,NY),st.f0,src,dst,st.r,st.u,st.v,save,bounds,noise,st.tauinv,st.omtauinv);
+        }
+    };
+    if(solid.data_handle() != nullptr)
+        box(true_type{});
+    else
+        box(false_type{});
+}
+
+// advance nsteps time steps from f1 with the cache-oblivious traversal; same
+// contract as advance
+//
+// The periodic domain has no boundary to start the recursion from, so every
+// run of height T is split up front: each thread walks an upright trapezoid
+// over its slab of rows, then, after a barrier, an inverted one over the seam
+// to the next slab. In x the same split gives an upright zoid over [0,NX)
+// followed by the inverted one over the periodic seam at NX.
+void LBM::stream_collide_trapezoid(mdspan<double, dextents<size_t, 2>> f0, mdspan<double, dextents<size_t, 3>> f1, mdspan<double, dextents<size_t, 3>> f2, mdspan<double, dextents<size_t, 2>> r, mdspan<double, dextents<size_t, 2>> u, mdspan<double, dextents<size_t, 2>> v, unsigned int nsteps, bool save, bool watch)
+{
+    const double tauinv = 2.0/(6.0*nu+1.0);
+    const Noise first = noise(time_step);
+    const SpaceTime st{f0,{f1,f2},r,u,v,save ? nsteps-1 : -1u,watch ? nsteps-1 : -1u,kT > 0.0 ? &first : nullptr,tauinv,1.0-tauinv,
+                       &f1[0,1,0] - &f1[0,0,0] < &f1[1,0,0] - &f1[0,0,0]};
+
+    // an upright zoid of width W lasts 1+W/2 steps
+    const size_t slab = NY/pool.size();
+    const unsigned int height = 1+min(NX,slab)/2;
+    const ptrdiff_t nx = NX;
+
+    for(unsigned int t0 = 0; t0 < nsteps; t0 += height)
+    {
+        const unsigned int t1 = min(nsteps,t0+height);
+        pool.run([&](unsigned int tid)
+        {
+            const ptrdiff_t yb = pool.begin(tid,NY), ye = pool.end(tid,NY);
+            walk({t0,t1,{0,yb},{1,1},{nx,ye},{-1,-1}},st,&watch_bounds[tid]);
+            walk({t0,t1,{nx,yb},{-1,1},{nx,ye},{1,-1}},st,&watch_bounds[tid]);
+        });
+        pool.run([&](unsigned int tid)
+        {
+            const ptrdiff_t ye = pool.end(tid,NY);
+            walk({t0,t1,{0,ye},{1,-1},{nx,ye},{-1,1}},st,&watch_bounds[tid]);
+            walk({t0,t1,{nx,ye},{-1,-1},{nx,ye},{1,1}},st,&watch_bounds[tid]);
+        });
+    }
 }
 
+// advance nsteps time steps from f1 with pipelined temporal blocking; same
+// contract as advance
+//
+// The threads form one wavefront: thread i computes step t0+i and follows
+// thread i-1 through the lattice, wave_lines lines of x at a time, so a line
+// passes through all steps of the block while it is in the shared cache. In
+// x, step t0+i covers the lines i <= x < NX-i only, which removes the periodic
+// dependency of the first line on the last one; the remaining seam at x = NX
+// is updated afterwards, one step at a time over slabs of y.
+void LBM::stream_collide_wavefront(mdspan<double, dextents<size_t, 2>> f0, mdspan<double, dextents<size_t, 3>> f1, mdspan<double, dextents<size_t, 3>> f2, mdspan<double, dextents<size_t, 2>> r, mdspan<double, dextents<size_t, 2>> u, mdspan<double, dextents<size_t, 2>> v, unsigned int nsteps, bool save, bool watch)
+{
+    const double tauinv = 2.0/(6.0*nu+1.0);
+    const Noise first = noise(time_step);
+    const SpaceTime st{f0,{f1,f2},r,u,v,save ? nsteps-1 : -1u,watch ? nsteps-1 : -1u,kT > 0.0 ? &first : nullptr,tauinv,1.0-tauinv,
+                       &f1[0,1,0] - &f1[0,0,0] < &f1[1,0,0] - &f1[0,0,0]};
+
+    // one step per thread, as long as the last step keeps some lines
+    const unsigned int depth = min<size_t>(pool.size(),max<size_t>(1,NX/2));
+    const ptrdiff_t nx = NX, ny = NY;
+
+    for(unsigned int t0 = 0; t0 < nsteps; t0 += depth)
+    {
+        const unsigned int k = min(depth,nsteps-t0);
+        for(WaveProgress &p : wave_progress)
+            p.x.store(0,memory_order_relaxed);
+
+        pool.run([&](unsigned int tid)
+        {
+            if(tid >= k)
+                return;
+            const size_t xe = NX-tid;
+            for(size_t x0 = tid; x0 < xe; x0 += wave_lines)
+            {
+                const size_t x1 = min(x0+wave_lines,xe);
+                if(tid > 0)
+                {
+                    // the previous step must have passed line x1, which also
+                    // means it no longer reads the lines that are overwritten
+                    const size_t need = min(x1+1,NX-tid+1);
+                    for(unsigned int spin = 0; wave_progress[tid-1].x.load(memory_order_acquire) < need; ++spin)
+                    {
+                        if(spin >= 4096)
+                            this_thread::yield();
+                    }
+                }
+                step_box(t0+tid,x0,x1,0,ny,st,&watch_bounds[tid]);
+                wave_progress[tid].x.store(x1,memory_order_release);
+            }
+        });
+
+        for(unsigned int i = 1; i < k; ++i)
+        {
+            pool.run([&](unsigned int tid)
+            {
+                step_box(t0+i,nx-i,nx+i,pool.begin(tid,NY),pool.end(tid,NY),st,&watch_bounds[tid]);
+            });
+        }
+    }
+}
 
 void LBM::compute_flow_properties(unsigned int t, mdspan<double, dextents<size_t, 2>> r,mdspan<double, dextents<size_t, 2>> u,mdspan<double, dextents<size_t, 2>> v, double *prop)
 {
@@ -212,50 +727,75 @@ void LBM::compute_flow_properties(unsigned int t, mdspan<double, dextents<size_t
     // 2: L2 error in ux
     // 3: L2 error in uy
     
-    double E = 0.0; // kinetic energy
-    
-    double sumrhoe2 = 0.0; // sum of error squared in rho
-    double sumuxe2 = 0.0;  //                         ux
-    double sumuye2 = 0.0;  //                         uy
-    
-    double sumrhoa2 = 0.0; // sum of analytical rho squared
-    double sumuxa2 = 0.0;  //                   ux
-    double sumuya2 = 0.0;  //                   uy
-    
-    for(unsigned int y = 0; y < NY; ++y)
+    // partial sums:
+    // 0: kinetic energy
+    // 1-3: sum of error squared in rho, ux, uy
+    // 4-6: sum of analytical rho, ux, uy squared
+    const PartialSums<7> &sums = flow_sums.run(pool,[&](size_t x0, size_t x1, size_t y0, size_t y1, PartialSums<7> &p)
     {
-        for(unsigned int x = 0; x < NX; ++x)
+        for(size_t y = y0; y < y1; ++y)
         {
-            double rho = r[x,y];
-            double ux  = u[x,y];
-            double uy  = v[x,y];
-            E += rho*(ux*ux + uy*uy);
-            
-            double rhoa, uxa, uya;
-            taylor_green_cfp(t,x,y,&rhoa,&uxa,&uya);
-            
-            sumrhoe2 += (rho-rhoa)*(rho-rhoa);
-            sumuxe2  += (ux-uxa)*(ux-uxa);
-            sumuye2  += (uy-uya)*(uy-uya);
+            for(size_t x = x0; x < x1; ++x)
+            {
+                double rho = r[x,y];
+                double ux  = u[x,y];
+                double uy  = v[x,y];
+                p.add(0,rho*(ux*ux + uy*uy));
+
+                double rhoa, uxa, uya;
+                taylor_green_cfp(t,x,y,&rhoa,&uxa,&uya);
+
+                p.add(1,(rho-rhoa)*(rho-rhoa));
+                p.add(2,(ux-uxa)*(ux-uxa));
+                p.add(3,(uy-uya)*(uy-uya));
 
-            sumrhoa2 += (rhoa-rho0)*(rhoa-rho0);
-            sumuxa2  += uxa*uxa;
-            sumuya2  += uya*uya;
+                p.add(4,(rhoa-rho0)*(rhoa-rho0));
+                p.add(5,uxa*uxa);
+                p.add(6,uya*uya);
+            }
         }
-    }
-    
-    prop[0] = E;
-    prop[1] = sqrt(sumrhoe2/sumrhoa2);
-    prop[2] = sqrt(sumuxe2/sumuxa2);
-    prop[3] = sqrt(sumuye2/sumuya2);
+    });
+
+    prop[0] = sums.value(0);
+    prop[1] = sqrt(sums.value(1)/sums.value(4));
+    prop[2] = sqrt(sums.value(2)/sums.value(5));
+    prop[3] = sqrt(sums.value(3)/sums.value(6));
 }
 
 void LBM::report_flow_properties(unsigned int t, mdspan<double, dextents<size_t, 2>> rho,mdspan<double, dextents<size_t, 2>> ux,mdspan<double, dextents<size_t, 2>> uy)
 {
     double prop[4];
     compute_flow_properties(t,rho,ux,uy,prop);
-    printf("%u,%g,%g,%g,%g\n",t,prop[0],prop[1],prop[2],prop[3]);
-    cout<<endl;
+    logger.data("flow",t,{{"E",prop[0]},{"L2_rho",prop[1]},{"L2_ux",prop[2]},{"L2_uy",prop[3]}});
+}
+
+MemoryConfig LBM::memory_config(bool out_of_core) const
+{
+    MemoryConfig c;
+    c.NX = NX;
+    c.NY = NY;
+    c.ndir = ndir;
+    c.value_bytes = sizeof(double);
+    c.lattices = 2;
+    c.staging = output.buffers()+(outputEncoding == OutputEncoding::Delta ? 3 : 0)+(streamPath != nullptr ? 3 : 0);
+    c.snapshots = pipelineDepth;
+    c.checkpoints = checkpointInterval > 0 ? max(checkpointBuffers,1u) : 0;
+    c.solids = initial.masked();
+    c.out_of_core = out_of_core;
+    return c;
+}
+
+void LBM::allocate_buffers()
+{
+    const size_t checkpoint = Arena::footprint<double>(NX*NY)+Arena::footprint<double>(NX*NY*(ndir-1));
+    const size_t stream = streamPath != nullptr ? SnapshotStream::footprint(NX,NY) : 0;
+    const unsigned int series_fields = outputEncoding == OutputEncoding::Delta ? 3 : 0;
+    arena.reserve(output.footprint(sizeof(double)*NX*NY)+series.footprint(series_fields)+stream+Arena::footprint<double>(NX*NY)*3*pipelineDepth+checkpoint*(checkpointInterval > 0 ? max(checkpointBuffers,1u) : 0));
+    output.allocate(arena,sizeof(double)*NX*NY);
+    if(series_fields > 0)
+        series.allocate(arena,series_fields);
+    if(outputEncoding == OutputEncoding::Hdf5)
+        hdf5.configure(NX,NY,tile_nx,tile_ny,floor(log10((double)NSTEPS)+1.0));
 }
 
 void LBM::save_scalar(const char* name, mdspan<double, dextents<size_t, 2>> scalar, unsigned int n)
@@ -263,7 +803,6 @@ void LBM::save_scalar(const char* name, mdspan<double, dextents<size_t, 2>> scal
     // assume reasonably-sized file names
     char filename[128];
     char format[16];
-    int ext = scalar.extent(0);
     
     // compute maximum number of digits
     int ndigits = floor(log10((double)NSTEPS)+1.0);
@@ -273,41 +812,61 @@ void LBM::save_scalar(const char* name, mdspan<double, dextents<size_t, 2>> scal
     sprintf(format,"%%s%%0%dd.bin",ndigits);
     sprintf(filename,format,name,n);
     
-    // open file for writing
-    //FILE *fout = fopen(filename,"wb+");
-
-    std::vector<double> tmp(scalar.size());    // write data
-    for (int i=0; i<scalar.extent(0); i++) {
-        for (int j=0; j<scalar.extent(1); j++) {
-            tmp[i*ext+j]=scalar[i,j];
-            //cout<<tmp[i+j]<<" ";
+    // gather into a staging buffer of the writer in file order (x fastest);
+    // save_scalar must not be called concurrently
+    double *staging = output.buffer();
+    for(size_t y = 0; y < NY; ++y)
+    {
+        for(size_t x = 0; x < NX; ++x)
+        {
+            staging[scalar_index(x,y)] = scalar[x,y];
         }
-        //std::cout<<endl;
     }
-
-    //fwrite(tmp,1,mem_size_scalar,fout);
-    //TODO write data correctly
-    // close file
-    //fclose(fout);
-    std::ofstream out(filename);
-    if (!out.is_open()) {
-        throw std::runtime_error("Cannot open output file");
+    
+    // raw files go through the writer backend, a delta series appends the
+    // step to <name>.lbs, HDF5 adds a dataset to the group of the step
+    if(outputEncoding == OutputEncoding::Delta)
+    {
+        sprintf(filename,"%s.lbs",name);
+        series.append(name,n,staging);
     }
-
-    // Array-Inhalte in Datei schreiben
-    for (double v : tmp) {
-        out << v ;
+    else if(outputEncoding == OutputEncoding::Hdf5 && hdf5.enabled())
+    {
+        snprintf(filename,sizeof(filename),"%s:%s",hdf5File,name);
+        hdf5.write(name,n,staging);
+    }
+    else
+        output.write(filename);
+    
+    if(!quiet)
+    {
+        logger.info("Saved to %s",filename);
     }
-    out<< "\n";
-    // //if(ferror(fout))
-    // {
-    //     fprintf(stderr,"Error saving to %s\n",filename);
-    //     perror("");
-    // }
-    // else
-    // {
-        if(!quiet){
-            printf("Saved to %s\n",filename);
-        }
 }
 
+// the watchdog bounds of all threads of the last watch step
+FlowBounds LBM::flow_bounds() const
+{
+    FlowBounds b;
+    b.reset();
+    for(const FlowBounds &p : watch_bounds)
+        b.merge(p);
+    return b;
+}
+
+// check the bounds after a watch step; returns false and reports the
+// extremes of the finite nodes and the count of the others if a limit was
+// crossed
+bool LBM::check_stability(unsigned int t)
+{
+    const FlowBounds b = flow_bounds();
+    if(b.violations == 0)
+        return true;
+
+    if(b.nonfinite == NX*NY)
+        logger.error("unstable at timestep %u, no node is finite.",t);
+    else
+        logger.error("unstable at timestep %u, %llu node(s) outside the limits, %llu of them not finite; the finite nodes have min rho %g (limit %g), max |u| %g (limit %g).",
+                     t,b.violations,b.nonfinite,b.rho_min,watchdogRhoMin,sqrt(b.usq_max),watchdogUMax);
+    return false;
+}
@@ -13,16 +13,63 @@
 //TODO LBM as class?
 
 #include <mdspan>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "arena.h"
+#include "cache_info.h"
+#include "fluctuations.h"
+#include "hdf5_writer.h"
+#include "initial.h"
+#include "jit.h"
+#include "logger.h"
+#include "output.h"
+#include "planner.h"
+#include "reduction.h"
+#include "series.h"
+#include "stream.h"
+#include "thread_pool.h"
 using namespace std;
 #ifndef __LBM_H
 #define __LBM_H
+
+// order in which stream_collide_save visits the nodes
+enum class Traversal {
+    Sweep,  // row by row over the whole width
+    Tiled,  // cache-blocked tiles sized from the detected caches
+    Trapezoid, // cache-oblivious space-time trapezoids over all steps between outputs
+    Wavefront  // pipelined temporal blocking, every thread advances the lines by one step
+};
+
+// streaming scheme of the Sweep and Tiled kernels
+enum class Streaming {
+    Pull,   // gather from the neighbours, store locally
+    Push    // load locally, scatter to the neighbours
+};
+
+inline const char* traversal_name(Traversal t)
+{
+    static const char *const names[] = {"sweep","tiled","trapezoid","wavefront"};
+    return names[int(t)];
+}
+
+inline const char* streaming_name(Streaming s)
+{
+    return s == Streaming::Push ? "push" : "pull";
+}
+
 class LBM {
 public:
     const unsigned int scale = 2;
-    const unsigned int NX = 32*scale;
-    const unsigned int NY = NX;
+    // size_t so that NX*NY and all index products are 64 bit
+    const size_t NX = 32*scale;
+    const size_t NY = NX;
 
     const unsigned int ndir = 9;
+    // f0 holds direction 0, f1/f2 hold directions 1..8 in slots 0..7
     const size_t mem_size_0dir   = sizeof(double)*NX*NY;
     const size_t mem_size_n0dir  = sizeof(double)*NX*NY*(ndir-1);
     const size_t mem_size_scalar = sizeof(double)*NX*NY;
@@ -31,45 +78,261 @@ public:
     const double ws = 1.0/9.0;  // adjacent weight
     const double wd = 1.0/36.0; // diagonal weight
 
-    const double nu = 1.0/6.0;
-    const double tau = 3.0*nu+0.5;
+    // not const: the members of an ensemble change the viscosity
+    double nu = 1.0/6.0;
+    double tau = 3.0*nu+0.5;
 
     // Taylor-Green parameters
     const double u_max = 0.04/scale;
     const double rho0 = 1.0;
 
+    // initial fields and solid mask read from raw or .npy files (--rho,
+    // --ux, --uy, --solid) instead of the Taylor-Green vortex, see initial.h
+    InitialFiles initial;
+
+    // obstacle voxelised from an STL surface (--stl): its cross-section at
+    // stlSlice of its z extent, stlScale nodes per STL unit and the STL
+    // origin at (stlOffsetX, stlOffsetY) in lattice units; the links from
+    // fluid to solid nodes with the wall distances go to wallLinksFile
+    // (nullptr: not written)
+    const double stlSlice = 0.5;
+    const double stlScale = 1.0;
+    const double stlOffsetX = 0.0;
+    const double stlOffsetY = 0.0;
+    const char *const wallLinksFile = "walls.csv";
+
+    // solid nodes (nonzero) of the mask, with halfway bounce-back on the
+    // links into them; no data handle without a mask
+    mdspan<unsigned char, dextents<size_t, 2>> solid;
+
     const unsigned int NSTEPS = 200*scale*scale;
     const unsigned int NSAVE  =  50*scale*scale;
     const unsigned int NMSG   =  50*scale*scale;
 
+    // adaptive output: instead of every NSAVE steps the moments are saved
+    // once the largest speed, probed every outputProbeInterval steps in the
+    // kernel pass, moved by more than outputChange times its peak since the
+    // last save; saves are at least outputMinInterval and at most
+    // outputMaxInterval steps apart (0: no upper bound)
+    const bool adaptiveOutput = false;
+    const unsigned int outputProbeInterval = NMSG/5;
+    const double outputChange = 0.1;
+    const unsigned int outputMinInterval = NSAVE/5;
+    const unsigned int outputMaxInterval = 4*NSAVE;
+
     // compute L2 error and energy?
     // disable for speed testing
     const bool computeFlowProperties = true;
 
+    // use compensated summation in the diagnostics
+    const bool compensatedSums = true;
+
     // suppress verbose output
     const bool quiet = true;
-    //TODO write constuctors
 
-    void taylor_green(unsigned int,unsigned int,unsigned int,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 2>>);
+    // all reporting goes through the asynchronous logger, errors to stderr;
+    // only errors in the command line, before it exists, are printed
+    // directly
+    const LogFormat logFormat = LogFormat::CSV;
+    Logger logger{stdout,stderr,logFormat};
+
+    // snapshots of the moments in flight between the solver and the
+    // analysis/output stages
+    const unsigned int pipelineDepth = 4;
+
+    // output backend of save_scalar; io_uring keeps outputChunk-sized writes
+    // in flight and falls back to pwrite where it is not available
+    const OutputBackend outputBackend = OutputBackend::Posix;
+    const size_t outputChunk = 1 << 20;
+    OutputWriter output{outputBackend,outputChunk,logger};
+
+    // encoding of the saved fields: raw .bin files per step, per field a
+    // series of key frames every deltaKeyInterval saves and deltas against
+    // the previous save, deflated when built with zlib, or, when built with
+    // HDF5, all fields in hdf5File, chunked like the tiles and filtered with
+    // shuffle and deflate at level hdf5Deflate (0: no filters)
+    const OutputEncoding outputEncoding = OutputEncoding::Raw;
+    const unsigned int deltaKeyInterval = 16;
+    SeriesWriter series{NX,NY,deltaKeyInterval,logger};
+    const char *const hdf5File = "fields.h5";
+    const unsigned int hdf5Deflate = 0;
+    Hdf5Writer hdf5{hdf5File,hdf5Deflate,logger};
+
+    // live streaming of the saved moments to a consumer on the same node
+    // that listens on the Unix socket or reads the FIFO at streamPath
+    // (nullptr disables it, --stream sets it); a consumer that falls behind
+    // stalls the output stage (Block) or misses frames (Drop).
+    // streamCompress deflates the frames when built with zlib, streamFiles
+    // also writes the .bin files while streaming
+    const char *streamPath = nullptr;
+    const StreamPolicy streamPolicy = StreamPolicy::Drop;
+    const bool streamCompress = false;
+    const bool streamFiles = false;
+
+    // progress metrics file, rewritten every metricsInterval seconds;
+    // nullptr disables it
+    const char *const metricsFile = "metrics.json";
+    const double metricsInterval = 1.0;
+
+    // checkpoints: every checkpointInterval steps (0 disables them) the
+    // populations are copied into one of checkpointBuffers in-memory buffers
+    // and written to checkpoint<step>.lbm in the background; only the last
+    // checkpointKeep files are kept (0 keeps all), those of earlier runs in
+    // the directory go first; checkpointCompress deflates them when built
+    // with zlib
+    const unsigned int checkpointInterval = 0;
+    const unsigned int checkpointBuffers = 1;
+    const unsigned int checkpointKeep = 2;
+    const bool checkpointCompress = false;
+
+    // check the memory plan against the available memory before allocating
+    const bool admissionCheck = true;
+
+    // steps after which the allocation audit expects no more heap
+    // allocations (only active when built with LBM_ALLOC_AUDIT)
+    const unsigned int allocAuditWarmup = 10;
+
+    // fluctuating LBM: thermal energy kT in lattice units (0 disables the
+    // noise) and the seed of the counter-based generator
+    const double kT = 0.0;
+    unsigned long long noiseSeed = 1;
+
+    // steps taken by advance() so far; keys the thermal noise
+    unsigned int time_step = 0;
+
+    // ensemble: run the first ensembleSpinup steps once, then fork
+    // ensembleMembers processes (0 disables it) that share the fields
+    // copy-on-write; member k writes to ensemble<k>/ and continues with the
+    // viscosity scaled by 1+k*ensembleNuSpread and the noise seed noiseSeed+k
+    const unsigned int ensembleMembers = 0;
+    const unsigned int ensembleSpinup = NSTEPS/4;
+    const double ensembleNuSpread = 0.05;
+
+    // stability watchdog: every watchdogInterval steps (0 disables it) the
+    // kernel also tracks the smallest density and the largest speed; the run
+    // stops with a dump of the populations in the checkpoint format,
+    // watchdog<step>.lbm, once the density falls below watchdogRhoMin, the
+    // speed exceeds watchdogUMax or a value is not finite
+    const unsigned int watchdogInterval = 100;
+    const double watchdogRhoMin = 0.1*rho0;
+    const double watchdogUMax = 0.5;
+
+    // worker threads, kept alive for the whole run
+    const unsigned int nthreads = thread::hardware_concurrency();
+    ThreadPool pool{nthreads};
+
+    // node traversal and streaming scheme of the kernel; the tile holds three lines of the inner
+    // dimension in half of L1 and the whole tile in half of L2
+    Traversal traversal = Traversal::Tiled;
+    Streaming streaming = Streaming::Pull;
+
+    // use a kernel compiled at start-up with the grid size, the tile of the
+    // traversal and the collision baked in (pull streaming with the Sweep and
+    // Tiled traversals); the shared objects are cached in jitCacheDir,
+    // nullptr for ~/.cache/lbm-jit
+    bool jit = false;
+    const char *const jitCacheDir = nullptr;
+    JitKernel jit_kernel;
+
+    const CacheInfo caches = detect_caches();
+    const size_t bytes_per_node = sizeof(double)*(2*(ndir-1)+1);
+    const size_t tile_ny = min(NY,max<size_t>(16,caches.l1/(2*3*bytes_per_node)));
+    const size_t tile_nx = min(NX,max<size_t>(4,caches.l2/(2*tile_ny*bytes_per_node)));
+
+    // Trapezoid traversal: zoids narrower than this are not cut in space
+    static constexpr ptrdiff_t zoid_min_width = 16;
+
+    // space-time trapezoid; in dimension d (0: x, 1: y) step t updates the
+    // nodes x0[d]+dx0[d]*(t-t0) <= i < x1[d]+dx1[d]*(t-t0), wrapped periodically
+    struct Zoid {
+        unsigned int t0, t1;
+        ptrdiff_t x0[2], dx0[2], x1[2], dx1[2];
+    };
+
+    // fields of a multi-step traversal; step s reads f[s%2] and writes f[(s+1)%2]
+    struct SpaceTime {
+        mdspan<double, dextents<size_t, 2>> f0;
+        mdspan<double, dextents<size_t, 3>> f[2];
+        mdspan<double, dextents<size_t, 2>> r, u, v;
+        unsigned int save_step;     // step that stores the moments, or -1
+        unsigned int watch_step;    // step checked by the watchdog, or -1
+        const Noise *noise;         // noise of the first step, or nullptr
+        double tauinv, omtauinv;
+        bool y_inner;               // y has the unit stride
+    };
+
+    // Wavefront traversal: lines of x handed from one thread to the next,
+    // sized so that the lines in flight between the first and the last
+    // thread stay in the last level cache
+    const size_t wave_lines = min(NX,max<size_t>(1,caches.l3/(2*(2*pool.size()+1)*NY*bytes_per_node)));
+
+    // lines completed by every thread of the current wavefront
+    struct alignas(64) WaveProgress {
+        atomic<size_t> x{0};
+    };
+    vector<WaveProgress> wave_progress = vector<WaveProgress>(pool.size());
+
+    // per-thread watchdog bounds of the current watch step
+    vector<FlowBounds> watch_bounds = vector<FlowBounds>(pool.size());
+
+    // tiled sums for compute_flow_properties, independent of nthreads
+    TileReduction<7> flow_sums{NX,NY,compensatedSums};
+
+    // buffers used inside the step loop, allocated once by allocate_buffers:
+    // the staging buffers of the output writer, the previous fields of the
+    // delta series (3 fields), the stream frame (3 fields),
+    // the pipeline snapshots (3 fields each) and the checkpoint buffers (ndir
+    // fields each)
+    Arena arena;
+
+    LBM() = default;
+    // domain of nx x ny nodes, e.g. for grids with more than 2^32 nodes
+    LBM(size_t nx, size_t ny) : NX(nx), NY(ny) {}
+
+    void taylor_green(unsigned int,size_t,size_t,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 2>>);
     void taylor_green(unsigned int, mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 2>>);
-    void taylor_green_cfp(unsigned int,unsigned int,unsigned int,double*,double*,double*);
+    void taylor_green_cfp(unsigned int,size_t,size_t,double*,double*,double*);
     void stream_collide_save(mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 3>>,mdspan<double, dextents<size_t, 3>>,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 2>>,bool);
+    void stream_collide_save(mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 3>>,mdspan<double, dextents<size_t, 3>>,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 2>>,bool,size_t,size_t,FlowBounds*,const Noise*);
+    void advance(mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 3>>,mdspan<double, dextents<size_t, 3>>,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 2>>,unsigned int,bool,bool);
+    void prepare_jit();
+    Noise noise(unsigned int) const;
+    void prepare_streaming(mdspan<double, dextents<size_t, 3>>&,mdspan<double, dextents<size_t, 3>>&);
+    void collide_node(size_t,size_t,const double*,double*,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 2>>,bool,FlowBounds*,const Noise*,double,double);
+    template<bool walls> void collide_stream_node(size_t,size_t,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 3>>,mdspan<double, dextents<size_t, 3>>,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 2>>,bool,FlowBounds*,const Noise*,double,double);
+    void stream_only(mdspan<double, dextents<size_t, 3>>,mdspan<double, dextents<size_t, 3>>,size_t,size_t);
+    void stream_back(mdspan<double, dextents<size_t, 3>>,mdspan<double, dextents<size_t, 3>>,size_t,size_t);
+    template<bool walls> void stream_collide_node(size_t,size_t,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 3>>,mdspan<double, dextents<size_t, 3>>,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 2>>,bool,FlowBounds*,const Noise*,double,double);
+    void stream_collide_trapezoid(mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 3>>,mdspan<double, dextents<size_t, 3>>,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 2>>,unsigned int,bool,bool);
+    void stream_collide_wavefront(mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 3>>,mdspan<double, dextents<size_t, 3>>,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 2>>,unsigned int,bool,bool);
+    void walk(const Zoid&,const SpaceTime&,FlowBounds*);
+    void step_box(unsigned int,ptrdiff_t,ptrdiff_t,ptrdiff_t,ptrdiff_t,const SpaceTime&,FlowBounds*);
+    void equilibrium_node(size_t,size_t,double,double,double,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 3>>);
     void init_equilibrium(mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 3>>,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 2>>);
     void compute_flow_properties(unsigned int,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 2>>,double*);
     void report_flow_properties(unsigned int,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 2>>,mdspan<double, dextents<size_t, 2>>);
     void save_scalar(const char*,mdspan<double, dextents<size_t, 2>>,unsigned int);
+    FlowBounds flow_bounds() const;
+    bool check_stability(unsigned int);
+
+    // traversals that fuse several time steps; they support pull streaming only
+    bool temporal() const { return traversal == Traversal::Trapezoid || traversal == Traversal::Wavefront; }
+
+    // memory needed by this configuration; check with admit() before allocating
+    MemoryConfig memory_config(bool out_of_core) const;
+    void allocate_buffers();
 
-    inline size_t field0_index(unsigned int x, unsigned int y)
+    inline size_t field0_index(size_t x, size_t y)
     {
         return NX*y+x;
     }
 
-    inline size_t scalar_index(unsigned int x, unsigned int y)
+    inline size_t scalar_index(size_t x, size_t y)
     {
         return NX*y+x;
     }
 
-    inline size_t fieldn_index(unsigned int x, unsigned int y, unsigned int d)
+    inline size_t fieldn_index(size_t x, size_t y, unsigned int d)
     {
         return (ndir-1)*(NX*y+x)+(d-1);
     }
@@ -0,0 +1,91 @@
+#include "alloc_audit.h"
+
+#ifdef LBM_ALLOC_AUDIT
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+static atomic<unsigned long long> allocations{0};
+
+unsigned long long AllocAudit::count()
+{
+    return allocations.load(memory_order_relaxed);
+}
+
+void AllocAudit::step(unsigned int n)
+{
+    unsigned long long now = count();
+    if(n > warmup && now != last)
+    {
+        fprintf(stderr,"Error: %llu heap allocation(s) during time step %u (after %u warmup steps).\n",now-last,n,warmup);
+        abort();
+    }
+    last = now;
+}
+
+static void* counted_alloc(size_t size, size_t align)
+{
+    allocations.fetch_add(1,memory_order_relaxed);
+    if(size == 0)
+        size = 1;
+    void *p = align > alignof(max_align_t) ? aligned_alloc(align,(size+align-1)/align*align) : malloc(size);
+    return p;
+}
+
+void* operator new(size_t size)
+{
+    void *p = counted_alloc(size,0);
+    if(p == nullptr)
+        throw bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, align_val_t align)
+{
+    void *p = counted_alloc(size,size_t(align));
+    if(p == nullptr)
+        throw bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size, align_val_t align)
+{
+    return operator new(size,align);
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept
+{
+    return counted_alloc(size,0);
+}
+
+void* operator new[](size_t size, const nothrow_t&) noexcept
+{
+    return counted_alloc(size,0);
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+void operator delete(void *p, align_val_t) noexcept { free(p); }
+void operator delete[](void *p, align_val_t) noexcept { free(p); }
+void operator delete(void *p, size_t, align_val_t) noexcept { free(p); }
+void operator delete[](void *p, size_t, align_val_t) noexcept { free(p); }
+
+#else
+
+unsigned long long AllocAudit::count()
+{
+    return 0;
+}
+
+#endif /* LBM_ALLOC_AUDIT */
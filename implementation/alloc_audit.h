@@ -0,0 +1,31 @@
+#ifndef __ALLOC_AUDIT_H
+#define __ALLOC_AUDIT_H
+
+/**
+ * Heap allocation auditing for the time step loop.
+ *
+ * Built with LBM_ALLOC_AUDIT, the global operator new is replaced by a
+ * version that counts every allocation of every thread. step() compares the
+ * count across time steps and aborts the run if anything was allocated
+ * after the first warmup steps. Without LBM_ALLOC_AUDIT step() does nothing.
+ */
+class AllocAudit {
+public:
+    explicit AllocAudit(unsigned int warmup) : warmup(warmup) {}
+
+    // heap allocations since program start; 0 without LBM_ALLOC_AUDIT
+    static unsigned long long count();
+
+    // called after step n completed
+#ifdef LBM_ALLOC_AUDIT
+    void step(unsigned int n);
+#else
+    void step(unsigned int) {}
+#endif
+
+private:
+    const unsigned int warmup;
+    unsigned long long last = 0;
+};
+
+#endif /* __ALLOC_AUDIT_H */
@@ -0,0 +1,17 @@
+#include "arena.h"
+
+using namespace std;
+
+void Arena::reserve(size_t bytes)
+{
+    if(base != nullptr)
+        throw bad_alloc();
+    base = static_cast<unsigned char*>(::operator new(bytes > 0 ? bytes : alignment,align_val_t(alignment)));
+    cap = bytes;
+}
+
+Arena::~Arena()
+{
+    if(base != nullptr)
+        ::operator delete(base,align_val_t(alignment));
+}
@@ -0,0 +1,67 @@
+#ifndef __ARENA_H
+#define __ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+/**
+ * Bump allocator over a single block that is allocated up front.
+ *
+ * All buffers needed in the time step loop (output staging, snapshots) are
+ * carved from the arena during setup, so the loop itself never touches the
+ * heap. The block is reserved once, after the memory plan admitted the run,
+ * and released only when the arena is destroyed.
+ */
+class Arena {
+public:
+    static const size_t alignment = 64;
+
+    Arena() = default;
+    ~Arena();
+
+    // allocate the block; may be called once
+    void reserve(size_t bytes);
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // n objects of type T, aligned to a cache line; throws bad_alloc when exhausted
+    template<class T>
+    T* allocate(size_t n)
+    {
+        size_t bytes = (n*sizeof(T)+alignment-1)/alignment*alignment;
+        if(bytes > cap-used_bytes)
+            throw std::bad_alloc();
+        T *p = reinterpret_cast<T*>(base+used_bytes);
+        used_bytes += bytes;
+        return p;
+    }
+
+    // n objects of type T aligned to align, a power of two, e.g. a page for
+    // O_DIRECT; footprint(n)+align bytes are enough
+    template<class T>
+    T* allocate(size_t n, size_t align)
+    {
+        size_t misalign = reinterpret_cast<uintptr_t>(base+used_bytes)%align;
+        size_t pad = misalign > 0 ? align-misalign : 0;
+        if(pad > cap-used_bytes)
+            throw std::bad_alloc();
+        used_bytes += pad;
+        return allocate<T>(n);
+    }
+
+    // bytes needed for n objects of type T, including padding
+    template<class T>
+    static size_t footprint(size_t n) { return (n*sizeof(T)+alignment-1)/alignment*alignment; }
+
+    size_t used() const { return used_bytes; }
+    size_t capacity() const { return cap; }
+
+private:
+    unsigned char *base = nullptr;
+    size_t cap = 0;
+    size_t used_bytes = 0;
+};
+
+#endif /* __ARENA_H */
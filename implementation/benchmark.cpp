@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "benchmark.h"
+#include "LBM.h"
+#include "seconds.h"
+
+using namespace std;
+
+void run_benchmark(LBM &lbm, mdspan<double, dextents<size_t, 2>> f0, mdspan<double, dextents<size_t, 3>> f1, mdspan<double, dextents<size_t, 3>> f2, mdspan<double, dextents<size_t, 2>> r, mdspan<double, dextents<size_t, 2>> u, mdspan<double, dextents<size_t, 2>> v)
+{
+    struct Variant {
+        Traversal traversal;
+        Streaming streaming;
+        bool jit;
+    };
+    static const Variant variants[] = {
+        {Traversal::Sweep,     Streaming::Pull, false},
+        {Traversal::Sweep,     Streaming::Push, false},
+        {Traversal::Tiled,     Streaming::Pull, false},
+        {Traversal::Tiled,     Streaming::Push, false},
+        {Traversal::Trapezoid, Streaming::Pull, false},
+        {Traversal::Wavefront, Streaming::Pull, false},
+        {Traversal::Sweep,     Streaming::Pull, true},
+    };
+
+    const size_t nodes = lbm.NX*lbm.NY;
+    const Traversal traversal = lbm.traversal;
+    const Streaming streaming = lbm.streaming;
+    const bool jit = lbm.jit;
+
+    // every variant starts from a copy of the initial state
+    vector<double> init0(nodes), init1(nodes*(lbm.ndir-1));
+    copy_n(f0.data_handle(),init0.size(),init0.begin());
+    copy_n(f1.data_handle(),init1.size(),init1.begin());
+    vector<double> reference;
+
+    lbm.logger.info(" ----- kernel benchmark -----");
+    lbm.logger.info("        timesteps: %u",lbm.NSTEPS);
+    for(const Variant &variant : variants)
+    {
+        lbm.traversal = variant.traversal;
+        lbm.streaming = variant.streaming;
+        lbm.jit = variant.jit;
+        if(lbm.jit)
+        {
+            lbm.prepare_jit();
+            if(!lbm.jit)
+                continue;
+        }
+        auto a = f1, b = f2;
+        copy(init0.begin(),init0.end(),f0.data_handle());
+        copy(init1.begin(),init1.end(),a.data_handle());
+        lbm.prepare_streaming(a,b);
+        lbm.time_step = 0;
+
+        double start = seconds();
+        lbm.advance(f0,a,b,r,u,v,lbm.NSTEPS,true,false);
+        double runtime = seconds()-start;
+
+        // largest deviation of rho from the first variant
+        double deviation = 0.0;
+        if(reference.empty())
+            reference.assign(r.data_handle(),r.data_handle()+nodes);
+        else
+        {
+            for(size_t i = 0; i < nodes; ++i)
+                deviation = max(deviation,fabs(r.data_handle()[i]-reference[i]));
+        }
+        char kernel[16];
+        snprintf(kernel,sizeof(kernel),"%s%s",streaming_name(variant.streaming),variant.jit ? " jit" : "");
+        lbm.logger.info("  %9s %-8s: %8.2f (Mlups)  max |rho - rho_ref| = %g",traversal_name(variant.traversal),kernel,
+                        double(lbm.NSTEPS)*nodes/(1e6*runtime),deviation);
+    }
+
+    lbm.traversal = traversal;
+    lbm.streaming = streaming;
+    lbm.jit = jit;
+}
@@ -0,0 +1,21 @@
+#ifndef __BENCHMARK_H
+#define __BENCHMARK_H
+
+#include <mdspan>
+
+class LBM;
+
+/**
+ * Kernel benchmark harness.
+ *
+ * Runs NSTEPS time steps with every traversal and streaming scheme, and with
+ * the JIT kernel if it can be built, on the given fields. Every variant
+ * starts from the same initial state and its speed is logged. The moments
+ * after the last step are compared with those of the first variant, so a
+ * variant that computes something different shows up next to its timing.
+ * f1 must hold the populations of init_equilibrium; the fields are
+ * overwritten.
+ */
+void run_benchmark(LBM &lbm, std::mdspan<double, std::dextents<size_t, 2>> f0, std::mdspan<double, std::dextents<size_t, 3>> f1, std::mdspan<double, std::dextents<size_t, 3>> f2, std::mdspan<double, std::dextents<size_t, 2>> r, std::mdspan<double, std::dextents<size_t, 2>> u, std::mdspan<double, std::dextents<size_t, 2>> v);
+
+#endif /* __BENCHMARK_H */
@@ -0,0 +1,74 @@
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include "cache_info.h"
+
+// size of the data or unified cache of the given level from sysfs, 0 if unknown
+static size_t sysfs_cache_size(unsigned int level)
+{
+    for(unsigned int index = 0; index < 8; ++index)
+    {
+        char path[128];
+        unsigned int l = 0;
+        char type[32] = "";
+        size_t kb = 0;
+
+        snprintf(path,sizeof(path),"/sys/devices/system/cpu/cpu0/cache/index%u/level",index);
+        FILE *f = fopen(path,"r");
+        if(f == nullptr)
+            break;
+        int ok = fscanf(f,"%u",&l);
+        fclose(f);
+        if(ok != 1 || l != level)
+            continue;
+
+        snprintf(path,sizeof(path),"/sys/devices/system/cpu/cpu0/cache/index%u/type",index);
+        f = fopen(path,"r");
+        if(f == nullptr)
+            continue;
+        ok = fscanf(f,"%31s",type);
+        fclose(f);
+        if(ok != 1 || strcmp(type,"Instruction") == 0)
+            continue;
+
+        snprintf(path,sizeof(path),"/sys/devices/system/cpu/cpu0/cache/index%u/size",index);
+        f = fopen(path,"r");
+        if(f == nullptr)
+            continue;
+        ok = fscanf(f,"%zuK",&kb);
+        fclose(f);
+        if(ok == 1)
+            return kb*1024;
+    }
+    return 0;
+}
+
+static size_t cache_size(int name, unsigned int level, size_t fallback)
+{
+    size_t size = 0;
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+    long s = sysconf(name);
+    if(s > 0)
+        size = s;
+#else
+    (void)name;
+#endif
+    if(size == 0)
+        size = sysfs_cache_size(level);
+    return size > 0 ? size : fallback;
+}
+
+CacheInfo detect_caches()
+{
+    CacheInfo c;
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+    c.l1 = cache_size(_SC_LEVEL1_DCACHE_SIZE,1,32*1024);
+    c.l2 = cache_size(_SC_LEVEL2_CACHE_SIZE, 2,1024*1024);
+    c.l3 = cache_size(_SC_LEVEL3_CACHE_SIZE, 3,8*1024*1024);
+#else
+    c.l1 = cache_size(0,1,32*1024);
+    c.l2 = cache_size(0,2,1024*1024);
+    c.l3 = cache_size(0,3,8*1024*1024);
+#endif
+    return c;
+}
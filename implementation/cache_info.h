@@ -0,0 +1,19 @@
+#ifndef __CACHE_INFO_H
+#define __CACHE_INFO_H
+
+#include <cstddef>
+
+// data cache sizes in bytes of the core the program starts on
+struct CacheInfo {
+    size_t l1;
+    size_t l2;
+    size_t l3;
+};
+
+/**
+ * Detects the cache sizes from sysconf, falling back to sysfs and finally
+ * to conservative defaults (32 KiB, 1 MiB, 8 MiB) where neither is available.
+ */
+CacheInfo detect_caches();
+
+#endif /* __CACHE_INFO_H */
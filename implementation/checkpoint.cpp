@@ -0,0 +1,444 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "checkpoint.h"
+#include "codec.h"
+#include "LBM.h"
+
+using namespace std;
+
+Checkpointer::Checkpointer(LBM &l) : lbm(l)
+{
+    if(lbm.checkpointInterval == 0)
+        return;
+
+    const size_t n = lbm.NX*lbm.NY;
+    buffers.resize(lbm.checkpointBuffers > 0 ? lbm.checkpointBuffers : 1);
+    free_list.reserve(buffers.size());
+    queue.resize(buffers.size());
+    for(auto &b : buffers)
+    {
+        b.f0 = lbm.arena.allocate<double>(n);
+        b.f1 = lbm.arena.allocate<double>(n*(lbm.ndir-1));
+        free_list.push_back(&b);
+    }
+    // files of earlier runs, e.g. the one this run restarts from, count as
+    // older than any new one and are rotated away first, oldest step first
+    if(lbm.checkpointKeep > 0)
+    {
+        if(DIR *dir = opendir("."))
+        {
+            while(const dirent *e = readdir(dir))
+            {
+                unsigned int t;
+                int end = 0;
+                if(sscanf(e->d_name,"checkpoint%u.lbm%n",&t,&end) == 1 && e->d_name[end] == '\0' && end > 0)
+                    on_disk.push_back(t);
+            }
+            closedir(dir);
+        }
+        sort(on_disk.begin(),on_disk.end());
+    }
+    on_disk.reserve(on_disk.size()+lbm.checkpointKeep+1);
+#ifdef LBM_HAVE_ZLIB
+    if(lbm.checkpointCompress)
+    {
+        encoder.allocate();
+        packed.resize(BlockEncoder::bound());
+    }
+#else
+    if(lbm.checkpointCompress)
+        lbm.logger.info("Warning: built without zlib, checkpoints are not compressed");
+#endif
+    thread = std::thread(&Checkpointer::loop,this);
+}
+
+Checkpointer::~Checkpointer()
+{
+    if(!thread.joinable())
+        return;
+    {
+        lock_guard<mutex> lock(m);
+        stop = true;
+    }
+    cv.notify_all();
+    thread.join();
+}
+
+void Checkpointer::submit(unsigned int t, mdspan<double, dextents<size_t, 2>> f0, mdspan<double, dextents<size_t, 3>> f1)
+{
+    Buffer *b;
+    {
+        unique_lock<mutex> lock(m);
+        if(error)
+            rethrow_exception(error);
+        cv.wait(lock,[this]{ return !free_list.empty(); });
+        b = free_list.back();
+        free_list.pop_back();
+    }
+
+    // both fields are contiguous, copy them in slabs
+    b->t = t;
+    const size_t n0 = lbm.NX*lbm.NY;
+    const size_t n1 = n0*(lbm.ndir-1);
+    lbm.pool.run([&](unsigned int tid)
+    {
+        size_t b0 = lbm.pool.begin(tid,n0), e0 = lbm.pool.end(tid,n0);
+        size_t b1 = lbm.pool.begin(tid,n1), e1 = lbm.pool.end(tid,n1);
+        memcpy(b->f0+b0,f0.data_handle()+b0,(e0-b0)*sizeof(double));
+        memcpy(b->f1+b1,f1.data_handle()+b1,(e1-b1)*sizeof(double));
+    });
+
+    {
+        lock_guard<mutex> lock(m);
+        queue[(head+count)%queue.size()] = b;
+        ++count;
+    }
+    cv.notify_all();
+}
+
+void Checkpointer::finish()
+{
+    if(!enabled())
+        return;
+    unique_lock<mutex> lock(m);
+    cv.wait(lock,[this]{ return (count == 0 && !writing) || error; });
+    if(error)
+        rethrow_exception(error);
+}
+
+void Checkpointer::loop()
+{
+    for(;;)
+    {
+        Buffer *b;
+        {
+            unique_lock<mutex> lock(m);
+            cv.wait(lock,[this]{ return count > 0 || stop; });
+            if(count == 0)
+                return;
+            b = queue[head];
+            head = (head+1)%queue.size();
+            --count;
+            writing = true;
+        }
+
+        try
+        {
+            write(*b);
+        }
+        catch(...)
+        {
+            lock_guard<mutex> lock(m);
+            if(!error)
+                error = current_exception();
+        }
+
+        {
+            lock_guard<mutex> lock(m);
+            writing = false;
+            free_list.push_back(b);
+        }
+        cv.notify_all();
+    }
+}
+
+// the values as they are, or byte-shuffled and deflated in blocks
+void Checkpointer::write_values(int fd, const double *data, size_t count)
+{
+#ifdef LBM_HAVE_ZLIB
+    if(lbm.checkpointCompress)
+    {
+        for(size_t i = 0; i < count; i += block_values)
+        {
+            const size_t n = min(block_values,count-i);
+            const size_t stored = encoder.encode(n,[&](size_t j) { return bits(data[i+j]); },packed.data());
+            write_bytes(fd,packed.data(),stored,"Error writing checkpoint");
+        }
+        return;
+    }
+#endif
+    write_bytes(fd,data,count*sizeof(double),"Error writing checkpoint");
+}
+
+// header of the populations of step t in the solver's configuration
+static CheckpointHeader checkpoint_header(const LBM &lbm, unsigned int t, uint32_t flags)
+{
+    CheckpointHeader h;
+    memset(&h,0,sizeof(h));
+    memcpy(h.magic,"LBMCKPT",8);
+    h.version = CheckpointHeader::current_version;
+    h.flags = flags;
+    h.NX = lbm.NX;
+    h.NY = lbm.NY;
+    h.ndir = lbm.ndir;
+    h.value_bytes = sizeof(double);
+    h.step = t;
+    h.streaming = lbm.streaming == Streaming::Push ? 1 : 0;
+    h.nu = lbm.nu;
+    h.kT = lbm.kT;
+    h.noise_seed = lbm.noiseSeed;
+    return h;
+}
+
+// write a checkpoint file under a temporary name, sync it and rename it
+// into place; values(fd) writes the populations after the header
+template<class Values>
+static void write_checkpoint(const char *filename, const CheckpointHeader &h, Values values)
+{
+    char tmpname[4096];
+    snprintf(tmpname,sizeof(tmpname),"%s.tmp",filename);
+    int fd = open(tmpname,O_WRONLY|O_CREAT|O_TRUNC,0644);
+    if(fd < 0)
+        throw runtime_error("Cannot open checkpoint file");
+    try
+    {
+        write_bytes(fd,&h,sizeof(h),"Error writing checkpoint");
+        values(fd);
+        // the file must be complete on disk before it replaces an older one
+        if(fdatasync(fd) != 0)
+            throw runtime_error("Error syncing checkpoint");
+    }
+    catch(...)
+    {
+        close(fd);
+        unlink(tmpname);
+        throw;
+    }
+    if(close(fd) != 0 || rename(tmpname,filename) != 0)
+        throw runtime_error("Error saving checkpoint");
+
+    // the rename itself must be on disk as well
+    const char *slash = strrchr(filename,'/');
+    const string dirname = slash == nullptr ? "." : slash == filename ? "/" : string(filename,slash);
+    int dir = open(dirname.c_str(),O_RDONLY|O_DIRECTORY);
+    if(dir < 0)
+        throw runtime_error("Cannot open checkpoint directory");
+    const bool synced = fsync(dir) == 0;
+    close(dir);
+    if(!synced)
+        throw runtime_error("Error syncing checkpoint directory");
+}
+
+void Checkpointer::write(const Buffer &b)
+{
+    char filename[128];
+    snprintf(filename,sizeof(filename),"checkpoint%u.lbm",b.t);
+    uint32_t flags = 0;
+#ifdef LBM_HAVE_ZLIB
+    flags = lbm.checkpointCompress ? CheckpointHeader::compressed : 0;
+#endif
+    write_checkpoint(filename,checkpoint_header(lbm,b.t,flags),[&](int fd)
+    {
+        write_values(fd,b.f0,lbm.NX*lbm.NY);
+        write_values(fd,b.f1,lbm.NX*lbm.NY*(lbm.ndir-1));
+    });
+
+    // rotate: keep the last checkpointKeep files, 0 keeps all
+    if(lbm.checkpointKeep > 0)
+    {
+        // a file of an earlier run may have been replaced
+        on_disk.erase(remove(on_disk.begin(),on_disk.end(),b.t),on_disk.end());
+        on_disk.push_back(b.t);
+        while(on_disk.size() > lbm.checkpointKeep)
+        {
+            snprintf(filename,sizeof(filename),"checkpoint%u.lbm",on_disk.front());
+            unlink(filename);
+            on_disk.erase(on_disk.begin());
+        }
+    }
+    if(!lbm.quiet)
+        lbm.logger.info("Saved checkpoint of timestep %u",b.t);
+}
+
+void save_checkpoint(LBM &lbm, const char *path, unsigned int t, mdspan<double, dextents<size_t, 2>> f0, mdspan<double, dextents<size_t, 3>> f1)
+{
+    // both fields are contiguous in the order of the file
+    write_checkpoint(path,checkpoint_header(lbm,t,0),[&](int fd)
+    {
+        write_bytes(fd,f0.data_handle(),lbm.NX*lbm.NY*sizeof(double),"Error writing checkpoint");
+        write_bytes(fd,f1.data_handle(),lbm.NX*lbm.NY*(lbm.ndir-1)*sizeof(double),"Error writing checkpoint");
+    });
+    lbm.logger.info("Saved populations of timestep %u to %s",t,path);
+}
+
+unsigned int load_checkpoint(LBM &lbm, const char *path, mdspan<double, dextents<size_t, 2>> f0, mdspan<double, dextents<size_t, 3>> &f1, mdspan<double, dextents<size_t, 3>> &f2, mdspan<double, dextents<size_t, 2>> r, mdspan<double, dextents<size_t, 2>> u, mdspan<double, dextents<size_t, 2>> v)
+{
+    int fd = open(path,O_RDONLY);
+    if(fd < 0)
+        throw runtime_error("Cannot open checkpoint file");
+    struct stat st;
+    if(fstat(fd,&st) != 0 || size_t(st.st_size) < sizeof(CheckpointHeader))
+    {
+        close(fd);
+        throw runtime_error("Checkpoint file is truncated");
+    }
+    const size_t file_bytes = st.st_size;
+    void *map = mmap(nullptr,file_bytes,PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd);
+    if(map == MAP_FAILED)
+        throw runtime_error("Cannot map checkpoint file");
+    const unsigned char *file = static_cast<const unsigned char*>(map);
+
+    // unmap on every way out
+    struct Unmap {
+        void *p;
+        size_t n;
+        ~Unmap() { munmap(p,n); }
+    } unmap{map,file_bytes};
+
+    CheckpointHeader h;
+    memcpy(&h,file,sizeof(h));
+    if(memcmp(h.magic,"LBMCKPT",8) != 0 || h.version > CheckpointHeader::current_version)
+        throw runtime_error("Not a checkpoint file of this version");
+    if(h.NX != lbm.NX || h.NY != lbm.NY || h.ndir != lbm.ndir)
+        throw runtime_error("Checkpoint was written for another grid");
+    if(h.value_bytes != sizeof(float) && h.value_bytes != sizeof(double))
+        throw runtime_error("Checkpoint has values of unknown precision");
+
+    const size_t n0 = lbm.NX*lbm.NY;
+    const size_t m = lbm.ndir-1;
+    const size_t bytes = n0*lbm.ndir*h.value_bytes;
+    const unsigned char *values = file+sizeof(h);
+    vector<unsigned char> decoded;
+    if(h.flags & CheckpointHeader::compressed)
+    {
+#ifdef LBM_HAVE_ZLIB
+        // the block sizes are read in turn, the blocks decoded in parallel
+        struct Block {
+            const unsigned char *packed;
+            uint64_t raw_bytes, packed_bytes, offset;
+        };
+        vector<Block> blocks;
+        size_t pos = sizeof(h), offset = 0;
+        while(offset < bytes)
+        {
+            uint64_t sizes[2];
+            if(pos+sizeof(sizes) > file_bytes)
+                throw runtime_error("Checkpoint file is truncated");
+            memcpy(sizes,file+pos,sizeof(sizes));
+            pos += sizeof(sizes);
+            if(sizes[0] == 0 || sizes[1] > file_bytes-pos || sizes[0] > bytes-offset || sizes[0]%h.value_bytes != 0)
+                throw runtime_error("Checkpoint file is corrupt");
+            blocks.push_back({file+pos,sizes[0],sizes[1],offset});
+            pos += sizes[1];
+            offset += sizes[0];
+        }
+
+        decoded.resize(bytes);
+        atomic<bool> ok{true};
+        lbm.pool.run([&](unsigned int tid)
+        {
+            vector<unsigned char> planes;
+            for(size_t i = lbm.pool.begin(tid,blocks.size()); i < lbm.pool.end(tid,blocks.size()); ++i)
+            {
+                const Block &b = blocks[i];
+                if(!inflate_block(b.packed,b.packed_bytes,b.raw_bytes,planes))
+                {
+                    ok = false;
+                    continue;
+                }
+                unsigned char *dst = decoded.data()+b.offset;
+                unshuffle_block(planes.data(),b.raw_bytes/h.value_bytes,h.value_bytes,[&](size_t j, uint64_t v)
+                {
+                    memcpy(dst+j*h.value_bytes,&v,h.value_bytes);
+                });
+            }
+        });
+        if(!ok)
+            throw runtime_error("Checkpoint file is corrupt");
+        values = decoded.data();
+#else
+        throw runtime_error("Compressed checkpoint, but built without zlib");
+#endif
+    }
+    else if(file_bytes-sizeof(h) < bytes)
+    {
+        throw runtime_error("Checkpoint file is truncated");
+    }
+
+    // value i of the file in double precision
+    auto value = [&](size_t i)
+    {
+        if(h.value_bytes == sizeof(float))
+        {
+            float f;
+            memcpy(&f,values+i*sizeof(float),sizeof(f));
+            return double(f);
+        }
+        double d;
+        memcpy(&d,values+i*sizeof(double),sizeof(d));
+        return d;
+    };
+
+    // every thread fills its slab of x, whatever the layout of the file
+    const bool planes = h.flags & CheckpointHeader::planes;
+    lbm.pool.run([&](unsigned int tid)
+    {
+        for(size_t x = lbm.pool.begin(tid,lbm.NX); x < lbm.pool.end(tid,lbm.NX); ++x)
+        {
+            for(size_t y = 0; y < lbm.NY; ++y)
+            {
+                const size_t node = x*lbm.NY+y;
+                f0[x,y] = value(node);
+                for(size_t d = 0; d < m; ++d)
+                    f1[x,y,d] = value(n0+(planes ? d*n0+node : node*m+d));
+            }
+        }
+    });
+
+    // the solver starts from the pull form, prepare_streaming converts it
+    if(h.streaming == 1)
+    {
+        lbm.pool.run([&](unsigned int tid)
+        {
+            lbm.stream_back(f1,f2,lbm.pool.begin(tid,lbm.NY),lbm.pool.end(tid,lbm.NY));
+        });
+        swap(f1,f2);
+    }
+
+    // the collision conserves mass and momentum, so the post-collision
+    // populations give the moments of the step; solid nodes are at rest
+    const bool walls = lbm.solid.data_handle() != nullptr;
+    lbm.pool.run([&](unsigned int tid)
+    {
+        for(size_t x = lbm.pool.begin(tid,lbm.NX); x < lbm.pool.end(tid,lbm.NX); ++x)
+        {
+            for(size_t y = 0; y < lbm.NY; ++y)
+            {
+                if(walls && lbm.solid[x,y])
+                {
+                    r[x,y] = lbm.rho0;
+                    u[x,y] = v[x,y] = 0.0;
+                    continue;
+                }
+                double rho = f0[x,y];
+                for(size_t d = 0; d < m; ++d)
+                    rho += f1[x,y,d];
+                r[x,y] = rho;
+                u[x,y] = (f1[x,y,0]+f1[x,y,4]+f1[x,y,7]-(f1[x,y,2]+f1[x,y,5]+f1[x,y,6]))/rho;
+                v[x,y] = (f1[x,y,1]+f1[x,y,4]+f1[x,y,5]-(f1[x,y,3]+f1[x,y,6]+f1[x,y,7]))/rho;
+            }
+        }
+    });
+
+    lbm.logger.info("Restarted from %s at timestep %u (%s, %s, %u byte values%s)",path,h.step,
+                    h.streaming == 1 ? "push" : "pull",planes ? "planes" : "interleaved",h.value_bytes,
+                    h.flags & CheckpointHeader::compressed ? ", compressed" : "");
+    if(h.nu != lbm.nu)
+        lbm.logger.info("Warning: the checkpoint was written with nu = %g, continuing with nu = %g",h.nu,lbm.nu);
+    if(lbm.kT > 0.0 && (h.kT != lbm.kT || h.noise_seed != lbm.noiseSeed))
+        lbm.logger.info("Warning: the checkpoint was written with other thermal noise parameters");
+
+    lbm.time_step = h.step;
+    return h.step;
+}
@@ -0,0 +1,109 @@
+#ifndef __CHECKPOINT_H
+#define __CHECKPOINT_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mdspan>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "codec.h"
+
+class LBM;
+
+// fixed-size header of a checkpoint file, followed by the populations: f0 as
+// NX*NY values and f1 as NX*NY*(ndir-1) values in the order of the solver
+// arrays (x, y, direction; the direction is contiguous), or with the
+// planes flag as ndir-1 planes of NX*NY values (direction, x, y). Compressed
+// files store the values as blocks of two uint64_t sizes (raw, packed) and
+// the packed bytes, the bytes of the values shuffled into planes.
+struct CheckpointHeader {
+    static const uint32_t current_version = 1;
+    static const uint32_t compressed = 1;   // flag
+    static const uint32_t planes = 2;       // flag
+
+    char magic[8];          // "LBMCKPT"
+    uint32_t version;
+    uint32_t flags;
+    uint64_t NX, NY;
+    uint32_t ndir;
+    uint32_t value_bytes;   // bytes per population value
+    uint32_t step;          // time step of the populations
+    uint32_t streaming;     // 0: pull, 1: push (f1 already streamed)
+    double nu, kT;
+    uint64_t noise_seed;
+};
+
+/**
+ * Multilevel asynchronous checkpointing of the populations.
+ *
+ * The first level is in memory: submit() copies the populations of a step
+ * boundary into one of a fixed number of buffers carved from the LBM arena,
+ * in parallel on the thread pool, and returns. The second level is on disk:
+ * a background thread writes the buffers to checkpoint<step>.lbm, optionally
+ * compressed, syncs and renames them into place, syncs the directory, and
+ * removes the oldest file once more than checkpointKeep are on disk; files
+ * found in the directory at start, e.g. from the run this one restarts
+ * from, count as the oldest. submit() blocks only when all buffers are still
+ * being written, so the solver pays for a memcpy.
+ */
+class Checkpointer {
+public:
+    explicit Checkpointer(LBM &lbm);
+    ~Checkpointer();
+
+    Checkpointer(const Checkpointer&) = delete;
+    Checkpointer& operator=(const Checkpointer&) = delete;
+
+    bool enabled() const { return !buffers.empty(); }
+
+    // queue the populations of step t; f1 holds the populations the next
+    // step starts from
+    void submit(unsigned int t, std::mdspan<double, std::dextents<size_t, 2>> f0, std::mdspan<double, std::dextents<size_t, 3>> f1);
+
+    // write everything queued; rethrows the first error of the writer
+    void finish();
+
+private:
+    struct Buffer {
+        unsigned int t;
+        double *f0, *f1;    // carved from the LBM arena
+    };
+
+    void loop();
+    void write(const Buffer &b);
+    void write_values(int fd, const double *data, size_t count);
+
+    LBM &lbm;
+    std::vector<Buffer> buffers;
+    std::vector<unsigned int> on_disk;  // steps of the files kept, oldest first
+    BlockEncoder encoder;
+    std::vector<unsigned char> packed;
+
+    std::mutex m;
+    std::condition_variable cv;
+    std::vector<Buffer*> free_list;
+    std::vector<Buffer*> queue;         // FIFO of at most buffers.size() entries
+    size_t head = 0, count = 0;
+    bool writing = false;
+    bool stop = false;
+    std::exception_ptr error;
+    std::thread thread;
+};
+
+// write the populations of step t to path in the checkpoint format, right
+// away and uncompressed, e.g. for the post-mortem of a run the watchdog
+// stopped; f1 holds the populations the next step starts from. Throws on
+// error.
+void save_checkpoint(LBM &lbm, const char *path, unsigned int t, std::mdspan<double, std::dextents<size_t, 2>> f0, std::mdspan<double, std::dextents<size_t, 3>> f1);
+
+// restart from a checkpoint written by any thread count, layout, precision
+// (float or double values) and streaming scheme: the values are decoded and
+// redistributed into f0 and f1 in parallel, in the pull form the solver
+// starts from, and the moments are recomputed. Sets and returns the time
+// step of the checkpoint; throws if the file does not fit the grid.
+unsigned int load_checkpoint(LBM &lbm, const char *path, std::mdspan<double, std::dextents<size_t, 2>> f0, std::mdspan<double, std::dextents<size_t, 3>> &f1, std::mdspan<double, std::dextents<size_t, 3>> &f2, std::mdspan<double, std::dextents<size_t, 2>> r, std::mdspan<double, std::dextents<size_t, 2>> u, std::mdspan<double, std::dextents<size_t, 2>> v);
+
+#endif /* __CHECKPOINT_H */
@@ -0,0 +1,64 @@
+#include <cerrno>
+#include <stdexcept>
+#include <unistd.h>
+#ifdef LBM_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#include "codec.h"
+
+using namespace std;
+
+void write_bytes(int fd, const void *data, size_t bytes, const char *what)
+{
+    const char *p = static_cast<const char*>(data);
+    while(bytes > 0)
+    {
+        ssize_t w = ::write(fd,p,bytes);
+        if(w < 0 && errno == EINTR)
+            continue;
+        if(w <= 0)
+            throw runtime_error(what);
+        p += w;
+        bytes -= w;
+    }
+}
+
+size_t BlockEncoder::bound()
+{
+#ifdef LBM_HAVE_ZLIB
+    return 2*sizeof(uint64_t)+compressBound(block_values*sizeof(uint64_t));
+#else
+    return 2*sizeof(uint64_t)+block_values*sizeof(uint64_t);
+#endif
+}
+
+size_t BlockEncoder::store(size_t raw_bytes, unsigned char *out)
+{
+    uint64_t sizes[2] = {raw_bytes,raw_bytes};
+    unsigned char *stored = out+sizeof(sizes);
+#ifdef LBM_HAVE_ZLIB
+    uLongf packed_bytes = bound()-sizeof(sizes);
+    if(compress2(stored,&packed_bytes,planes.data(),raw_bytes,Z_BEST_SPEED) != Z_OK)
+        throw runtime_error("Error compressing block");
+    sizes[1] = packed_bytes;
+#else
+    memcpy(stored,planes.data(),raw_bytes);
+#endif
+    memcpy(out,sizes,sizeof(sizes));
+    return sizeof(sizes)+sizes[1];
+}
+
+bool inflate_block(const unsigned char *stored, size_t stored_bytes, size_t raw_bytes, vector<unsigned char> &planes)
+{
+#ifdef LBM_HAVE_ZLIB
+    planes.resize(raw_bytes);
+    uLongf inflated = raw_bytes;
+    return uncompress(planes.data(),&inflated,stored,stored_bytes) == Z_OK && inflated == raw_bytes;
+#else
+    (void)stored;
+    (void)stored_bytes;
+    (void)raw_bytes;
+    (void)planes;
+    return false;
+#endif
+}
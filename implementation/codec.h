@@ -0,0 +1,88 @@
+#ifndef __CODEC_H
+#define __CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// The block encoding shared by compressed checkpoints, field series and
+// stream frames: the values are cut into blocks of up to block_values
+// words, byte k of every word of a block goes to plane k, and the planes are
+// deflated. Neighbouring values agree in their high bytes, so the leading
+// planes compress well. An encoded block is two uint64_t sizes (raw,
+// stored) followed by the stored bytes.
+
+// words per block
+static const size_t block_values = 131072;
+
+// write bytes with plain system calls; throws runtime_error(what) on error
+void write_bytes(int fd, const void *data, size_t bytes, const char *what);
+
+// byte k of word(j), j < n, goes to planes[k*n+j]
+template<class Word>
+void shuffle_block(size_t n, Word word, unsigned char *planes)
+{
+    for(size_t j = 0; j < n; ++j)
+    {
+        const uint64_t v = word(j);
+        for(size_t k = 0; k < sizeof(uint64_t); ++k)
+            planes[k*n+j] = (v >> (8*k)) & 0xff;
+    }
+}
+
+// the inverse for words of width bytes: store(j, word) for j < n
+template<class Store>
+void unshuffle_block(const unsigned char *planes, size_t n, size_t width, Store store)
+{
+    for(size_t j = 0; j < n; ++j)
+    {
+        uint64_t v = 0;
+        for(size_t k = 0; k < width; ++k)
+            v |= uint64_t(planes[k*n+j]) << (8*k);
+        store(j,v);
+    }
+}
+
+// the bit pattern of a double, the word of the shuffle
+inline uint64_t bits(double v)
+{
+    uint64_t b;
+    memcpy(&b,&v,sizeof(b));
+    return b;
+}
+
+/**
+ * Encoder of shuffled, deflated blocks.
+ *
+ * Holds the planes of one block, so a writer allocates its scratch once.
+ * Without zlib (LBM_HAVE_ZLIB) the planes are stored as they are.
+ */
+class BlockEncoder {
+public:
+    // scratch for blocks of up to block_values words
+    void allocate() { planes.resize(block_values*sizeof(uint64_t)); }
+
+    // bytes of an encoded block at most
+    static size_t bound();
+
+    // encode word(j), j < n <= block_values, at out, which has room for
+    // bound() bytes; returns the bytes written. Throws on error.
+    template<class Word>
+    size_t encode(size_t n, Word word, unsigned char *out)
+    {
+        shuffle_block(n,word,planes.data());
+        return store(n*sizeof(uint64_t),out);
+    }
+
+private:
+    size_t store(size_t raw_bytes, unsigned char *out);
+
+    std::vector<unsigned char> planes;
+};
+
+// inflate the stored bytes of a block into raw_bytes of planes; false if
+// the block is corrupt or the build has no zlib
+bool inflate_block(const unsigned char *stored, size_t stored_bytes, size_t raw_bytes, std::vector<unsigned char> &planes);
+
+#endif /* __CODEC_H */
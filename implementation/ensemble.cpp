@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "checkpoint.h"
+#include "ensemble.h"
+#include "LBM.h"
+
+using namespace std;
+
+static const double bytesPerMiB = 1024.0*1024.0;
+
+// set up member k in a freshly forked child
+static void become_member(LBM &lbm, unsigned int k)
+{
+    char dir[32];
+    snprintf(dir,sizeof(dir),"ensemble%u",k);
+    if((mkdir(dir,0777) != 0 && errno != EEXIST) || chdir(dir) != 0 || freopen("log.txt","w",stdout) == nullptr)
+    {
+        fprintf(stderr,"Error: cannot set up the output of ensemble member %u: %s\n",k,strerror(errno));
+        exit(-1);
+    }
+
+    // only the forking thread exists in the child
+    lbm.logger.after_fork();
+    lbm.pool.after_fork();
+
+    lbm.nu *= 1.0+k*lbm.ensembleNuSpread;
+    lbm.tau = 3.0*lbm.nu+0.5;
+    lbm.noiseSeed += k;
+    if(lbm.jit)
+    {
+        // the collision constants are baked into the kernel
+        lbm.jit_kernel.unload();
+        lbm.prepare_jit();
+    }
+
+    lbm.logger.info("Ensemble member %u",k);
+    lbm.logger.info("      domain size: %zux%zu",lbm.NX,lbm.NY);
+    lbm.logger.info("               nu: %g",lbm.nu);
+    lbm.logger.info("              tau: %g",lbm.tau);
+    if(lbm.kT > 0.0)
+        lbm.logger.info("               kT: %g (seed %llu)",lbm.kT,lbm.noiseSeed);
+    lbm.logger.info("       start step: %u",lbm.time_step);
+    lbm.logger.info("%s","");
+}
+
+unsigned int fork_ensemble(LBM &lbm, mdspan<double, dextents<size_t, 2>> f0, mdspan<double, dextents<size_t, 3>> &f1, mdspan<double, dextents<size_t, 3>> &f2, mdspan<double, dextents<size_t, 2>> r, mdspan<double, dextents<size_t, 2>> u, mdspan<double, dextents<size_t, 2>> v)
+{
+    // the spin-up ends at ensembleSpinup, or right away for a restart
+    // beyond it
+    const unsigned int start = lbm.time_step;
+    const unsigned int spinup = max(start,min(lbm.ensembleSpinup,lbm.NSTEPS));
+    lbm.logger.info(" ----- ensemble -----");
+    lbm.logger.info("          members: %u",lbm.ensembleMembers);
+    lbm.logger.info("          spin-up: %u (steps)",spinup-start);
+
+    // every member eventually owns a private copy of the fields it writes
+    const size_t member_bytes = plan_memory(lbm.memory_config(false)).total();
+    const size_t have = available_memory().usable();
+    if(have > 0 && member_bytes*(lbm.ensembleMembers+1) > have)
+        lbm.logger.info("Warning: %u members need up to %.1f MiB, %.1f MiB are available",lbm.ensembleMembers,member_bytes*(lbm.ensembleMembers+1)/bytesPerMiB,have/bytesPerMiB);
+
+    // the common prefix; it ends with the moments for the first output of
+    // the members and a watchdog check
+    if(spinup > start)
+    {
+        lbm.advance(f0,f1,f2,r,u,v,spinup-start,true,lbm.watchdogInterval > 0);
+        if((spinup-start)%2 == 1)
+            swap(f1,f2);
+        if(lbm.watchdogInterval > 0 && !lbm.check_stability(spinup))
+        {
+            char dump[64];
+            snprintf(dump,sizeof(dump),"watchdog%u.lbm",spinup);
+            save_checkpoint(lbm,dump,spinup,f0,f1);
+            lbm.logger.flush();
+            exit(-1);
+        }
+    }
+
+    // nothing may be in flight across fork()
+    lbm.logger.flush();
+    fflush(stdout);
+
+    vector<pid_t> members;
+    for(unsigned int k = 0; k < lbm.ensembleMembers; ++k)
+    {
+        pid_t pid = fork();
+        if(pid == 0)
+        {
+            become_member(lbm,k);
+            return spinup;
+        }
+        if(pid < 0)
+        {
+            lbm.logger.error("cannot fork ensemble member %u: %s",k,strerror(errno));
+            break;
+        }
+        members.push_back(pid);
+    }
+
+    bool failed = members.size() < lbm.ensembleMembers;
+    for(unsigned int k = 0; k < members.size(); ++k)
+    {
+        int status = 0;
+        while(waitpid(members[k],&status,0) < 0 && errno == EINTR)
+            ;
+        bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        lbm.logger.info("  member %u (pid %d): %s",k,int(members[k]),ok ? "completed" : "failed");
+        failed = failed || !ok;
+    }
+    lbm.logger.flush();
+    exit(failed ? -1 : 0);
+}
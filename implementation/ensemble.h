@@ -0,0 +1,24 @@
+#ifndef __ENSEMBLE_H
+#define __ENSEMBLE_H
+
+#include <mdspan>
+
+class LBM;
+
+/**
+ * Ensemble of runs that share their spin-up.
+ *
+ * Takes the first ensembleSpinup steps once and then forks ensembleMembers
+ * child processes. The children start with the fields of the parent mapped
+ * copy-on-write, so the spin-up is neither repeated nor copied; a page is
+ * duplicated only when a member writes it. Every member continues in its own
+ * directory ensemble<k> with its own log, outputs and perturbed viscosity
+ * and noise seed. The parent only waits for the members and exits.
+ *
+ * Returns the step the members continue from, in the members only. Must be
+ * called before the pipeline and the metrics start their threads, and the
+ * fields must live on the heap: mapped backing files would be shared.
+ */
+unsigned int fork_ensemble(LBM &lbm, std::mdspan<double, std::dextents<size_t, 2>> f0, std::mdspan<double, std::dextents<size_t, 3>> &f1, std::mdspan<double, std::dextents<size_t, 3>> &f2, std::mdspan<double, std::dextents<size_t, 2>> r, std::mdspan<double, std::dextents<size_t, 2>> u, std::mdspan<double, std::dextents<size_t, 2>> v);
+
+#endif /* __ENSEMBLE_H */
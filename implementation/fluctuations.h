@@ -0,0 +1,104 @@
+#ifndef __FLUCTUATIONS_H
+#define __FLUCTUATIONS_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Philox4x32-10 counter-based random number generator (Salmon et al., SC'11).
+ *
+ * The output is a pure function of a 128 bit counter and a 64 bit key, so
+ * there is no generator state: any thread can draw the numbers of any node
+ * and step in any order, and the loop over the nodes stays vectorisable.
+ */
+struct Philox4x32 {
+    static inline void round(uint32_t c[4], const uint32_t k[2])
+    {
+        const uint64_t p0 = uint64_t(0xD2511F53u)*c[0];
+        const uint64_t p1 = uint64_t(0xCD9E8D57u)*c[2];
+        const uint32_t c1 = c[1], c3 = c[3];
+        c[0] = uint32_t(p1 >> 32)^c1^k[0];
+        c[1] = uint32_t(p1);
+        c[2] = uint32_t(p0 >> 32)^c3^k[1];
+        c[3] = uint32_t(p0);
+    }
+
+    // the four random words for counter c and key k; c is overwritten
+    static inline void generate(uint32_t c[4], const uint32_t key[2])
+    {
+        uint32_t k[2] = {key[0],key[1]};
+        for(int r = 0; r < 10; ++r)
+        {
+            if(r > 0)
+            {
+                k[0] += 0x9E3779B9u;
+                k[1] += 0xBB67AE85u;
+            }
+            round(c,k);
+        }
+    }
+};
+
+/**
+ * Thermal noise of one time step of the fluctuating lattice Boltzmann method.
+ *
+ * The noise is added in moment space to the six non-conserved moments of the
+ * orthogonal D2Q9 basis of Dünweg, Schiller and Ladd (PRE 76, 036704, 2007):
+ * the stresses 3c^2-2, cx^2-cy^2 and cx*cy, and the ghost moments
+ * (3c^2-4)cx, (3c^2-4)cy and 9c^4-15c^2+2. Mode k of a node gets
+ * sqrt(mu rho b_k (1-gamma^2)) r_k with mu = 3 kT, b_k the norm of the mode
+ * and gamma = 1-1/tau, so mass and momentum are conserved exactly. The r_k
+ * are uniform with unit variance and come from Philox keyed by the seed,
+ * with the counter (x, y, step, draw); the noise therefore depends neither on
+ * the thread count nor on the traversal, and a restarted run reproduces it
+ * from the step number alone.
+ */
+struct Noise {
+    uint32_t key[2];
+    uint32_t step;
+    double amp2;    // mu (1-gamma^2)
+
+    // add the noise of node (x,y) with density rho to the post-collision
+    // populations fc
+    inline void apply(size_t x, size_t y, double rho, double *fc) const
+    {
+        // mode values e_ki of directions 0..8 (numbering as in the kernel)
+        static constexpr int e[9][6] = {
+            {-2,  0,  0,  0,  0,  2},
+            { 1,  1,  0, -1,  0, -4},
+            { 1, -1,  0,  0, -1, -4},
+            { 1,  1,  0,  1,  0, -4},
+            { 1, -1,  0,  0,  1, -4},
+            { 4,  0,  1,  2,  2,  8},
+            { 4,  0, -1, -2,  2,  8},
+            { 4,  0,  1, -2, -2,  8},
+            { 4,  0, -1,  2, -2,  8},
+        };
+        // 1/sqrt(b_k) with b_k = sum_i w_i e_ki^2
+        static constexpr double inv_sqrt_b[6] = {0.5,1.5,3.0,1.2247448713915890491,1.2247448713915890491,0.25};
+        static constexpr double w[9] = {4.0/9.0,1.0/9.0,1.0/9.0,1.0/9.0,1.0/9.0,1.0/36.0,1.0/36.0,1.0/36.0,1.0/36.0};
+
+        uint32_t c0[4] = {uint32_t(x),uint32_t(y),step,0};
+        uint32_t c1[4] = {uint32_t(x),uint32_t(y),step,1};
+        Philox4x32::generate(c0,key);
+        Philox4x32::generate(c1,key);
+        const uint32_t bits[6] = {c0[0],c0[1],c0[2],c0[3],c1[0],c1[1]};
+
+        // uniform on [-sqrt(3),sqrt(3)) has unit variance
+        const double a = std::sqrt(amp2*rho);
+        double m[6];
+        for(int k = 0; k < 6; ++k)
+            m[k] = a*inv_sqrt_b[k]*((bits[k]*(1.0/4294967296.0)-0.5)*3.4641016151377545870);
+
+        for(int i = 0; i < 9; ++i)
+        {
+            double s = 0.0;
+            for(int k = 0; k < 6; ++k)
+                s += e[i][k]*m[k];
+            fc[i] += w[i]*s;
+        }
+    }
+};
+
+#endif /* __FLUCTUATIONS_H */
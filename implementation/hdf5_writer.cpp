@@ -0,0 +1,181 @@
+#include <cstdio>
+#include <stdexcept>
+#include <type_traits>
+#include <unistd.h>
+#ifdef LBM_HAVE_HDF5
+#include <hdf5.h>
+#endif
+#include "hdf5_writer.h"
+#include "logger.h"
+
+using namespace std;
+
+Hdf5Writer::Hdf5Writer(const char *p, unsigned int d, Logger &l) : path(p), deflate(d), logger(l)
+{
+}
+
+void Hdf5Writer::configure(size_t nx, size_t ny, size_t cnx, size_t cny, unsigned int nd)
+{
+    NX = nx;
+    NY = ny;
+    chunk_nx = cnx < 1 ? 1 : cnx > nx ? nx : cnx;
+    chunk_ny = cny < 1 ? 1 : cny > ny ? ny : cny;
+    digits = nd;
+#ifndef LBM_HAVE_HDF5
+    logger.info("Warning: built without HDF5, writing the fields as .bin files");
+#endif
+}
+
+#ifdef LBM_HAVE_HDF5
+
+static_assert(is_same_v<hid_t,int64_t>,"HDF5 1.10 or later is required");
+
+// throws on a negative HDF5 return value
+static hid_t check(hid_t r)
+{
+    if(r < 0)
+        throw runtime_error("Error writing HDF5 file");
+    return r;
+}
+
+static void write_attribute(hid_t obj, const char *name, uint64_t value)
+{
+    hid_t s = check(H5Screate(H5S_SCALAR));
+    hid_t a = H5Acreate2(obj,name,H5T_STD_U64LE,s,H5P_DEFAULT,H5P_DEFAULT);
+    herr_t r = a < 0 ? -1 : H5Awrite(a,H5T_NATIVE_UINT64,&value);
+    if(a >= 0)
+        H5Aclose(a);
+    H5Sclose(s);
+    check(r);
+}
+
+static uint64_t read_attribute(hid_t obj, const char *name)
+{
+    uint64_t value = 0;
+    hid_t a = H5Aopen(obj,name,H5P_DEFAULT);
+    herr_t r = a < 0 ? -1 : H5Aread(a,H5T_NATIVE_UINT64,&value);
+    if(a >= 0)
+        H5Aclose(a);
+    if(r < 0)
+        throw runtime_error("HDF5 file has no grid attributes");
+    return value;
+}
+
+Hdf5Writer::~Hdf5Writer()
+{
+    if(dcpl >= 0)
+        H5Pclose(dcpl);
+    if(space >= 0)
+        H5Sclose(space);
+    if(file >= 0)
+        H5Fclose(file);
+}
+
+bool Hdf5Writer::enabled() const
+{
+    return true;
+}
+
+void Hdf5Writer::open()
+{
+    if(resuming && access(path,F_OK) == 0)
+    {
+        file = H5Fopen(path,H5F_ACC_RDWR,H5P_DEFAULT);
+        if(file < 0)
+            throw runtime_error("Cannot open HDF5 file");
+        if(read_attribute(file,"NX") != NX || read_attribute(file,"NY") != NY)
+            throw runtime_error("HDF5 file was written for another grid");
+    }
+    else
+    {
+        file = H5Fcreate(path,H5F_ACC_TRUNC,H5P_DEFAULT,H5P_DEFAULT);
+        if(file < 0)
+            throw runtime_error("Cannot create HDF5 file");
+        write_attribute(file,"NX",NX);
+        write_attribute(file,"NY",NY);
+    }
+
+    // the file order is y, x with x fastest
+    const hsize_t dims[2] = {NY,NX};
+    const hsize_t chunk[2] = {chunk_ny,chunk_nx};
+    space = check(H5Screate_simple(2,dims,nullptr));
+    dcpl = check(H5Pcreate(H5P_DATASET_CREATE));
+    check(H5Pset_chunk(dcpl,2,chunk));
+    bool filters = false;
+    if(deflate > 0 && H5Zfilter_avail(H5Z_FILTER_DEFLATE) > 0)
+    {
+        check(H5Pset_shuffle(dcpl));
+        check(H5Pset_deflate(dcpl,deflate));
+        filters = true;
+    }
+    else if(deflate > 0)
+        logger.info("Warning: HDF5 has no deflate filter, writing uncompressed datasets");
+    logger.info("           output: HDF5 %s, %zux%zu chunks%s",path,chunk_nx,chunk_ny,filters ? ", shuffle+deflate" : "");
+}
+
+void Hdf5Writer::write(const char *name, unsigned int t, const double *values)
+{
+    if(file < 0)
+        open();
+
+    char group[32];
+    snprintf(group,sizeof(group),"step%0*u",int(digits),t);
+    hid_t g;
+    if(H5Lexists(file,group,H5P_DEFAULT) > 0)
+        g = check(H5Gopen2(file,group,H5P_DEFAULT));
+    else
+    {
+        g = check(H5Gcreate2(file,group,H5P_DEFAULT,H5P_DEFAULT,H5P_DEFAULT));
+        try
+        {
+            write_attribute(g,"step",t);
+        }
+        catch(...)
+        {
+            H5Gclose(g);
+            throw;
+        }
+    }
+
+    // a step written again, e.g. after a restart, replaces the dataset
+    herr_t r = 0;
+    if(H5Lexists(g,name,H5P_DEFAULT) > 0)
+        r = H5Ldelete(g,name,H5P_DEFAULT);
+    hid_t d = r < 0 ? -1 : H5Dcreate2(g,name,H5T_IEEE_F64LE,space,H5P_DEFAULT,dcpl,H5P_DEFAULT);
+    r = d < 0 ? -1 : H5Dwrite(d,H5T_NATIVE_DOUBLE,H5S_ALL,H5S_ALL,H5P_DEFAULT,values);
+    if(d >= 0)
+        H5Dclose(d);
+    H5Gclose(g);
+    check(r);
+}
+
+void Hdf5Writer::flush()
+{
+    if(file >= 0)
+        check(H5Fflush(file,H5F_SCOPE_LOCAL));
+}
+
+#else
+
+Hdf5Writer::~Hdf5Writer()
+{
+}
+
+bool Hdf5Writer::enabled() const
+{
+    return false;
+}
+
+void Hdf5Writer::open()
+{
+}
+
+void Hdf5Writer::write(const char*, unsigned int, const double*)
+{
+}
+
+void Hdf5Writer::flush()
+{
+}
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef __HDF5_WRITER_H
+#define __HDF5_WRITER_H
+
+#include <cstddef>
+#include <cstdint>
+
+class Logger;
+
+/**
+ * HDF5 output of the saved fields.
+ *
+ * All fields of a run go into one file: a group per saved step (step<t>,
+ * with the step as an attribute) holding a NY x NX dataset of doubles per
+ * field, in the order of the .bin files (x fastest). The datasets are
+ * chunked like the tiles of the solver and optionally pass the shuffle and
+ * deflate filters. The file is opened by the first write, on the output
+ * stage, so forked ensemble members write their own files. A new run
+ * replaces the file of an earlier one; after resume(), for a restart, an
+ * existing file of the same grid is continued and steps written again
+ * replace the old datasets. Built without HDF5, enabled() is false and
+ * save_scalar writes .bin files.
+ */
+class Hdf5Writer {
+public:
+    Hdf5Writer(const char *path, unsigned int deflate, Logger &logger);
+    ~Hdf5Writer();
+
+    Hdf5Writer(const Hdf5Writer&) = delete;
+    Hdf5Writer& operator=(const Hdf5Writer&) = delete;
+
+    bool enabled() const;
+
+    // grid, chunk shape (the tile of the solver) and step digits of the group names
+    void configure(size_t NX, size_t NY, size_t chunk_nx, size_t chunk_ny, unsigned int digits);
+
+    // continue an existing file instead of replacing it; called before the
+    // first write
+    void resume() { resuming = true; }
+
+    // write the values of step t, in file order, as dataset name of its group
+    void write(const char *name, unsigned int t, const double *values);
+
+    // push what was written to the file
+    void flush();
+
+private:
+    void open();
+
+    const char *const path;
+    const unsigned int deflate;
+    Logger &logger;
+    size_t NX = 0, NY = 0, chunk_nx = 0, chunk_ny = 0;
+    unsigned int digits = 1;
+    bool resuming = false;
+
+    // HDF5 handles (hid_t), negative while closed
+    int64_t file = -1, space = -1, dcpl = -1;
+};
+
+#endif /* __HDF5_WRITER_H */
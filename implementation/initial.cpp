@@ -0,0 +1,332 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "initial.h"
+#include "LBM.h"
+#include "voxel.h"
+
+using namespace std;
+
+// element types of the files
+enum class Element {
+    F8,     // float64
+    F4,     // float32
+    U1      // uint8 or bool
+};
+
+static const char* element_name(Element e)
+{
+    static const char *const names[] = {"float64","float32","uint8"};
+    return names[int(e)];
+}
+
+static size_t element_bytes(Element e)
+{
+    return e == Element::F8 ? sizeof(double) : e == Element::F4 ? sizeof(float) : 1;
+}
+
+// a field file mapped read-only; the values are read in place, no copy of
+// the file is made
+struct FieldFile {
+    const char *path;
+    const unsigned char *map = nullptr;
+    size_t map_bytes = 0;
+    const unsigned char *values = nullptr;
+    Element type = Element::F8;
+    size_t nx = 0, ny = 0;  // grid of the file
+    size_t sx = 0, sy = 0;  // element strides of x and y
+    size_t NX = 0, NY = 0;  // grid of the solver
+
+    FieldFile(const char *path, size_t NX, size_t NY);
+    ~FieldFile() { munmap(const_cast<unsigned char*>(map),map_bytes); }
+
+    FieldFile(const FieldFile&) = delete;
+    FieldFile& operator=(const FieldFile&) = delete;
+
+    bool resampled() const { return nx != NX || ny != NY; }
+
+    // value of node (i,j) of the file grid
+    double at(size_t i, size_t j) const
+    {
+        const unsigned char *p = values+(i*sx+j*sy)*element_bytes(type);
+        if(type == Element::F8)
+        {
+            double d;
+            memcpy(&d,p,sizeof(d));
+            return d;
+        }
+        if(type == Element::F4)
+        {
+            float f;
+            memcpy(&f,p,sizeof(f));
+            return f;
+        }
+        return *p;
+    }
+
+    // value at node (x,y) of the solver grid, interpolated bilinearly and
+    // periodically between the node centres of another grid
+    double sample(size_t x, size_t y) const
+    {
+        if(!resampled())
+            return at(x,y);
+        const double px = (x+0.5)*nx/NX-0.5;
+        const double py = (y+0.5)*ny/NY-0.5;
+        const double fx = px-floor(px);
+        const double fy = py-floor(py);
+        const size_t i0 = size_t(ptrdiff_t(floor(px))+ptrdiff_t(nx))%nx, i1 = (i0+1)%nx;
+        const size_t j0 = size_t(ptrdiff_t(floor(py))+ptrdiff_t(ny))%ny, j1 = (j0+1)%ny;
+        return (1.0-fy)*((1.0-fx)*at(i0,j0)+fx*at(i1,j0))+fy*((1.0-fx)*at(i0,j1)+fx*at(i1,j1));
+    }
+
+    // whether the node of the file grid nearest to node (x,y) is nonzero
+    bool nonzero(size_t x, size_t y) const
+    {
+        const size_t i = min(size_t((x+0.5)*nx/NX),nx-1);
+        const size_t j = min(size_t((y+0.5)*ny/NY),ny-1);
+        return at(i,j) != 0.0;
+    }
+
+private:
+    void parse_npy();
+};
+
+[[noreturn]] static void fail(const char *what, const char *path)
+{
+    throw runtime_error(string(what)+": "+path);
+}
+
+FieldFile::FieldFile(const char *p, size_t nX, size_t nY) : path(p), NX(nX), NY(nY)
+{
+    int fd = open(path,O_RDONLY);
+    if(fd < 0)
+        fail("Cannot open initial file",path);
+    struct stat st;
+    if(fstat(fd,&st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        fail("Initial file is empty",path);
+    }
+    map_bytes = st.st_size;
+    void *m = mmap(nullptr,map_bytes,PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd);
+    if(m == MAP_FAILED)
+        fail("Cannot map initial file",path);
+    map = static_cast<const unsigned char*>(m);
+    // every page is read once, start reading all of them ahead
+    madvise(m,map_bytes,MADV_WILLNEED);
+
+    if(map_bytes >= 6 && memcmp(map,"\x93NUMPY",6) == 0)
+    {
+        try
+        {
+            parse_npy();
+        }
+        catch(...)
+        {
+            munmap(m,map_bytes);
+            throw;
+        }
+        return;
+    }
+
+    // raw values in the order of the .bin files, the size tells their type
+    const size_t n = NX*NY;
+    if(map_bytes == n*sizeof(double))
+        type = Element::F8;
+    else if(map_bytes == n*sizeof(float))
+        type = Element::F4;
+    else if(map_bytes == n)
+        type = Element::U1;
+    else
+    {
+        munmap(m,map_bytes);
+        fail("Initial file does not fit the grid",path);
+    }
+    values = map;
+    nx = NX;
+    ny = NY;
+    sx = 1;
+    sy = NX;
+}
+
+// the .npy header: magic, version, header length and a Python dict literal
+// with the keys descr, fortran_order and shape, padded with spaces
+void FieldFile::parse_npy()
+{
+    if(map_bytes < 10)
+        fail("Initial file is truncated",path);
+    size_t start, len;
+    if(map[6] == 1)
+    {
+        start = 10;
+        len = map[8] | size_t(map[9]) << 8;
+    }
+    else if((map[6] == 2 || map[6] == 3) && map_bytes >= 12)
+    {
+        start = 12;
+        len = map[8] | size_t(map[9]) << 8 | size_t(map[10]) << 16 | size_t(map[11]) << 24;
+    }
+    else
+        fail("Unsupported .npy version",path);
+    if(start+len > map_bytes)
+        fail("Initial file is truncated",path);
+    const string dict(reinterpret_cast<const char*>(map+start),len);
+
+    // position after the colon that follows key
+    auto value = [&](const char *key)
+    {
+        size_t pos = dict.find(key);
+        if(pos == string::npos || (pos = dict.find(':',pos)) == string::npos)
+            fail("Malformed .npy header",path);
+        return dict.find_first_not_of(' ',pos+1);
+    };
+
+    size_t pos = value("'descr'");
+    if(pos == string::npos || dict[pos] != '\'')
+        fail("Malformed .npy header",path);
+    const string descr = dict.substr(pos+1,dict.find('\'',pos+1)-pos-1);
+    if(descr == "<f8")
+        type = Element::F8;
+    else if(descr == "<f4")
+        type = Element::F4;
+    else if(descr == "|u1" || descr == "|b1")
+        type = Element::U1;
+    else
+        fail("Unsupported .npy type, use float64, float32, uint8 or bool",path);
+
+    pos = value("'fortran_order'");
+    const bool fortran = pos != string::npos && dict.compare(pos,4,"True") == 0;
+
+    pos = value("'shape'");
+    if(pos == string::npos || dict[pos] != '(')
+        fail("Malformed .npy header",path);
+    vector<size_t> shape;
+    const char *s = dict.c_str()+pos+1;
+    for(;;)
+    {
+        while(*s == ' ' || *s == ',')
+            ++s;
+        if(*s == ')' || *s == '\0')
+            break;
+        char *end;
+        shape.push_back(strtoull(s,&end,10));
+        if(end == s)
+            fail("Malformed .npy header",path);
+        s = end;
+    }
+    if(shape.size() != 2 || shape[0] == 0 || shape[1] == 0)
+        fail("Initial .npy array must have the shape (ny, nx)",path);
+    ny = shape[0];
+    nx = shape[1];
+    sx = fortran ? ny : 1;
+    sy = fortran ? 1 : nx;
+
+    values = map+start+len;
+    if(size_t(map+map_bytes-values) < nx*ny*element_bytes(type))
+        fail("Initial file is truncated",path);
+}
+
+// the mapped file of path, nullptr without one
+static unique_ptr<FieldFile> map_field(const char *path, const LBM &lbm)
+{
+    return path != nullptr ? make_unique<FieldFile>(path,lbm.NX,lbm.NY) : nullptr;
+}
+
+void load_initial(LBM &lbm, mdspan<double, dextents<size_t, 2>> f0, mdspan<double, dextents<size_t, 3>> f1, mdspan<double, dextents<size_t, 3>> f2, mdspan<double, dextents<size_t, 2>> r, mdspan<double, dextents<size_t, 2>> u, mdspan<double, dextents<size_t, 2>> v)
+{
+    const unique_ptr<FieldFile> rho_file = map_field(lbm.initial.rho,lbm);
+    const unique_ptr<FieldFile> ux_file = map_field(lbm.initial.ux,lbm);
+    const unique_ptr<FieldFile> uy_file = map_field(lbm.initial.uy,lbm);
+    const unique_ptr<FieldFile> mask = map_field(lbm.initial.solid,lbm);
+    const bool taylor_green = !rho_file || !ux_file || !uy_file;
+    const bool masked = lbm.initial.masked();
+    if(masked && lbm.solid.data_handle() == nullptr)
+        throw runtime_error("No memory for the solid mask");
+
+    // the voxelised surface first, the mask file is added to it below
+    unique_ptr<Voxeliser> surface;
+    if(lbm.initial.stl != nullptr)
+    {
+        surface = make_unique<Voxeliser>(lbm.initial.stl,lbm.stlSlice,lbm.stlScale,lbm.stlOffsetX,lbm.stlOffsetY);
+        surface->fill(lbm.pool,lbm.solid);
+    }
+
+    // the files have x fastest, the solver arrays y: every thread converts
+    // its slab of x in blocks of a cache line of x, so each line of a file is
+    // read once while the populations are written along y
+    const size_t block = 64/sizeof(double);
+    const size_t m = lbm.ndir-1;
+    vector<size_t> solids(lbm.pool.size());
+    lbm.pool.run([&](unsigned int tid)
+    {
+        const size_t xb = lbm.pool.begin(tid,lbm.NX), xe = lbm.pool.end(tid,lbm.NX);
+        for(size_t x0 = xb; x0 < xe; x0 += block)
+        {
+            const size_t x1 = min(x0+block,xe);
+            for(size_t y = 0; y < lbm.NY; ++y)
+            {
+                for(size_t x = x0; x < x1; ++x)
+                {
+                    double rho = lbm.rho0, ux = 0.0, uy = 0.0;
+                    const bool wall = masked && ((surface && lbm.solid[x,y]) || (mask && mask->nonzero(x,y)));
+                    if(masked)
+                        lbm.solid[x,y] = wall;
+                    if(wall)
+                        ++solids[tid];
+                    else
+                    {
+                        if(taylor_green)
+                            lbm.taylor_green_cfp(0,x,y,&rho,&ux,&uy);
+                        if(rho_file)
+                            rho = rho_file->sample(x,y);
+                        if(ux_file)
+                            ux = ux_file->sample(x,y);
+                        if(uy_file)
+                            uy = uy_file->sample(x,y);
+                    }
+                    r[x,y] = rho;
+                    u[x,y] = ux;
+                    v[x,y] = uy;
+                    lbm.equilibrium_node(x,y,rho,ux,uy,f0,f1);
+                    // solid nodes are never updated, both lattices hold them
+                    if(wall)
+                    {
+                        for(size_t d = 0; d < m; ++d)
+                            f2[x,y,d] = f1[x,y,d];
+                    }
+                }
+            }
+        }
+    });
+
+    for(const FieldFile *f : {rho_file.get(),ux_file.get(),uy_file.get()})
+    {
+        if(f != nullptr)
+            lbm.logger.info("Initial field from %s (%zux%zu %s%s)",f->path,f->nx,f->ny,element_name(f->type),f->resampled() ? ", interpolated" : "");
+    }
+    if(mask)
+        lbm.logger.info("Solid mask from %s (%zux%zu %s%s)",mask->path,mask->nx,mask->ny,element_name(mask->type),mask->resampled() ? ", nearest" : "");
+    if(surface)
+    {
+        lbm.logger.info("Voxelised %s (%zu triangles, %zu segments at z = %g)",lbm.initial.stl,surface->triangles(),surface->segments(),surface->plane());
+        if(lbm.wallLinksFile != nullptr)
+            write_wall_links(lbm.wallLinksFile,surface->links(lbm.pool,lbm.solid));
+    }
+    if(masked)
+    {
+        size_t count = 0;
+        for(size_t c : solids)
+            count += c;
+        lbm.logger.info("      solid nodes: %zu",count);
+    }
+}
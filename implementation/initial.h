@@ -0,0 +1,40 @@
+#ifndef __INITIAL_H
+#define __INITIAL_H
+
+#include <cstddef>
+#include <mdspan>
+
+class LBM;
+
+// files of the initial fields and of the solid mask; a field without a file
+// is that of the Taylor-Green vortex at t=0. The solid nodes are those of
+// the mask and those inside the cross-section of the surface in the STL
+// file, see voxel.h; without either there are none. A file is either raw,
+// NX*NY values in the order of the .bin files (x fastest) as doubles, floats
+// or, for the mask, bytes, told apart by the file size, or a .npy array of
+// float64, float32, uint8 or bool of shape (ny, nx), in C or Fortran order.
+// A .npy field of another grid, e.g. the result of a coarse run, is
+// interpolated bilinearly and periodically at the node centres; a mask
+// takes the nearest node.
+struct InitialFiles {
+    const char *rho = nullptr;
+    const char *ux = nullptr;
+    const char *uy = nullptr;
+    const char *solid = nullptr;
+    const char *stl = nullptr;
+
+    bool masked() const { return solid != nullptr || stl != nullptr; }
+    bool any() const { return rho != nullptr || ux != nullptr || uy != nullptr || masked(); }
+};
+
+// set up the first step from lbm.initial: the surface is voxelised into
+// lbm.solid, the files are mapped and every thread converts its slab of x
+// straight into the equilibrium populations in f0 and f1 and the moments in
+// r, u, v, and adds the mask file to lbm.solid; the links from fluid to
+// solid nodes of a voxelised surface go to lbm.wallLinksFile.
+// Solid nodes are at rest with density rho0, in f2 as well since they are
+// never updated. Throws if a file cannot be read or does not fit the grid,
+// or the surface cannot be voxelised.
+void load_initial(LBM &lbm, std::mdspan<double, std::dextents<size_t, 2>> f0, std::mdspan<double, std::dextents<size_t, 3>> f1, std::mdspan<double, std::dextents<size_t, 3>> f2, std::mdspan<double, std::dextents<size_t, 2>> r, std::mdspan<double, std::dextents<size_t, 2>> u, std::mdspan<double, std::dextents<size_t, 2>> v);
+
+#endif /* __INITIAL_H */
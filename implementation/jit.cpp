@@ -0,0 +1,358 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <dlfcn.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "jit.h"
+#include "logger.h"
+#include "reduction.h"
+
+using namespace std;
+
+extern char **environ;
+
+static const char *const jit_flags[] = {"-std=c++17","-O3","-march=native","-ffp-contract=off","-fPIC","-shared"};
+
+// same operations in the same order as LBM::stream_collide_node and
+// LBM::collide_node, so the results are bitwise identical
+static const char *const kernel_source = R"(// generated by the lattice Boltzmann JIT
+#include <cmath>
+#include <cstddef>
+
+static const size_t NX = @NX@;
+static const size_t NY = @NY@;
+static const size_t TILE_NX = @TILENX@;
+static const size_t TILE_NY = @TILENY@;
+static const double tauinv = @TAUINV@;
+static const double omtauinv = @OMTAUINV@;
+static const double w0 = @W0@;
+static const double ws = @WS@;
+static const double wd = @WD@;
+static const double rho_limit = @RHOLIMIT@;
+static const double usq_limit = @USQLIMIT@;
+
+// layout of FlowBounds, checked against reduction.h of the solver
+struct alignas(64) FlowBounds {
+    double rho_min;
+    double usq_max;
+    unsigned long long violations;
+    unsigned long long nonfinite;
+};
+static_assert(sizeof(FlowBounds) == @FBSIZE@ && alignof(FlowBounds) == @FBALIGN@, "FlowBounds differs from reduction.h");
+static_assert(offsetof(FlowBounds,rho_min) == @FBRHOMIN@ && offsetof(FlowBounds,usq_max) == @FBUSQMAX@ && offsetof(FlowBounds,violations) == @FBVIOLATIONS@ && offsetof(FlowBounds,nonfinite) == @FBNONFINITE@, "FlowBounds differs from reduction.h");
+
+static inline size_t s(size_t x, size_t y) { return x*NY+y; }
+static inline size_t n(size_t x, size_t y, size_t d) { return (x*NY+y)*8+d; }
+
+extern "C" void lbm_jit_kernel(double *f0, const double *f1, double *f2, double *r, double *u, double *v,
+                               int save, FlowBounds *bounds, size_t ybegin, size_t yend)
+{
+    // tiles of TILE_NX x TILE_NY nodes, y contiguous inside a tile as in the
+    // tiled traversal of the solver; a sweep is a single tile
+    for(size_t y0 = ybegin; y0 < yend; y0 += TILE_NY)
+    {
+        const size_t y1 = y0+TILE_NY < yend ? y0+TILE_NY : yend;
+        for(size_t x0 = 0; x0 < NX; x0 += TILE_NX)
+        {
+            const size_t x1 = x0+TILE_NX < NX ? x0+TILE_NX : NX;
+            for(size_t x = x0; x < x1; ++x)
+            {
+                const size_t xp1 = (x+1)%NX;
+                const size_t xm1 = (NX+x-1)%NX;
+                for(size_t y = y0; y < y1; ++y)
+                {
+                    const size_t yp1 = (y+1)%NY;
+                    const size_t ym1 = (NY+y-1)%NY;
+
+                    double ft0 = f0[s(x,y)];
+                    double ft1 = f1[n(xm1,y,  0)];
+                    double ft2 = f1[n(x,  ym1,1)];
+                    double ft3 = f1[n(xp1,y,  2)];
+                    double ft4 = f1[n(x,  yp1,3)];
+                    double ft5 = f1[n(xm1,ym1,4)];
+                    double ft6 = f1[n(xp1,ym1,5)];
+                    double ft7 = f1[n(xp1,yp1,6)];
+                    double ft8 = f1[n(xm1,yp1,7)];
+
+                    double rho = ft0+ft1+ft2+ft3+ft4+ft5+ft6+ft7+ft8;
+                    double rhoinv = 1.0/rho;
+                    double ux = rhoinv*(ft1+ft5+ft8-(ft3+ft6+ft7));
+                    double uy = rhoinv*(ft2+ft5+ft6-(ft4+ft7+ft8));
+                    if(save)
+                    {
+                        r[s(x,y)] = rho;
+                        u[s(x,y)] = ux;
+                        v[s(x,y)] = uy;
+                    }
+                    if(bounds != nullptr)
+                    {
+                        double usq = ux*ux+uy*uy;
+                        bool finite = std::isfinite(rho) & std::isfinite(usq);
+                        bounds->rho_min = std::fmin(bounds->rho_min,finite ? rho : HUGE_VAL);
+                        bounds->usq_max = std::fmax(bounds->usq_max,finite ? usq : 0.0);
+                        bounds->violations += !(rho >= rho_limit) | !(usq <= usq_limit);
+                        bounds->nonfinite += !finite;
+                    }
+
+                    double tw0r = tauinv*w0*rho;
+                    double twsr = tauinv*ws*rho;
+                    double twdr = tauinv*wd*rho;
+                    double omusq = 1.0 - 1.5*(ux*ux+uy*uy);
+                    double tux = 3.0*ux;
+                    double tuy = 3.0*uy;
+
+                    f0[s(x,y)] = omtauinv*ft0 + tw0r*(omusq);
+                    double c;
+                    c = tux;      f2[n(x,y,0)] = omtauinv*ft1 + twsr*(omusq + c*(1.0+0.5*c));
+                    c = tuy;      f2[n(x,y,1)] = omtauinv*ft2 + twsr*(omusq + c*(1.0+0.5*c));
+                    c = -tux;     f2[n(x,y,2)] = omtauinv*ft3 + twsr*(omusq + c*(1.0+0.5*c));
+                    c = -tuy;     f2[n(x,y,3)] = omtauinv*ft4 + twsr*(omusq + c*(1.0+0.5*c));
+                    c = tux+tuy;  f2[n(x,y,4)] = omtauinv*ft5 + twdr*(omusq + c*(1.0+0.5*c));
+                    c = tuy-tux;  f2[n(x,y,5)] = omtauinv*ft6 + twdr*(omusq + c*(1.0+0.5*c));
+                    c = -(tux+tuy); f2[n(x,y,6)] = omtauinv*ft7 + twdr*(omusq + c*(1.0+0.5*c));
+                    c = tux-tuy;  f2[n(x,y,7)] = omtauinv*ft8 + twdr*(omusq + c*(1.0+0.5*c));
+                }
+            }
+        }
+    }
+}
+)";
+
+static void replace(string &s, const char *key, const string &value)
+{
+    for(size_t pos = s.find(key); pos != string::npos; pos = s.find(key,pos+value.size()))
+        s.replace(pos,strlen(key),value);
+}
+
+// exact text form of a double
+static string hex(double d)
+{
+    char buf[64];
+    snprintf(buf,sizeof(buf),"%a",d);
+    return buf;
+}
+
+// FNV-1a hash
+static unsigned long long fnv1a(const string &s)
+{
+    unsigned long long h = 14695981039346656037ull;
+    for(unsigned char c : s)
+    {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+// create dir and its missing parents
+static bool make_dirs(const string &dir)
+{
+    for(size_t pos = dir.find('/',1); pos != string::npos; pos = dir.find('/',pos+1))
+        mkdir(dir.substr(0,pos).c_str(),0755);
+    return mkdir(dir.c_str(),0755) == 0 || errno == EEXIST;
+}
+
+// run a command and wait for it, collecting its standard output if output
+// is given; true on success
+static bool run(const vector<const char*> &args, string *output = nullptr)
+{
+    vector<char*> argv;
+    for(const char *a : args)
+        argv.push_back(const_cast<char*>(a));
+    argv.push_back(nullptr);
+
+    int pipe_fd[2] = {-1,-1};
+    if(output != nullptr && pipe(pipe_fd) != 0)
+        return false;
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if(output != nullptr)
+    {
+        posix_spawn_file_actions_adddup2(&actions,pipe_fd[1],STDOUT_FILENO);
+        posix_spawn_file_actions_addclose(&actions,pipe_fd[0]);
+        posix_spawn_file_actions_addclose(&actions,pipe_fd[1]);
+    }
+    pid_t pid;
+    const bool spawned = posix_spawnp(&pid,argv[0],&actions,nullptr,argv.data(),environ) == 0;
+    posix_spawn_file_actions_destroy(&actions);
+    if(output != nullptr)
+    {
+        close(pipe_fd[1]);
+        char buffer[4096];
+        ssize_t n;
+        while(spawned && ((n = read(pipe_fd[0],buffer,sizeof(buffer))) > 0 || (n < 0 && errno == EINTR)))
+        {
+            if(n > 0)
+                output->append(buffer,n);
+        }
+        close(pipe_fd[0]);
+    }
+    if(!spawned)
+        return false;
+    int status = 0;
+    while(waitpid(pid,&status,0) < 0)
+    {
+        if(errno != EINTR)
+            return false;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// run the compiler on src; true on success
+static bool compile(const char *cxx, const string &src, const string &out)
+{
+    vector<const char*> args = {cxx};
+    for(const char *flag : jit_flags)
+        args.push_back(flag);
+    args.insert(args.end(),{src.c_str(),"-o",out.c_str()});
+    return run(args);
+}
+
+// the processor model and instruction set extensions from /proc/cpuinfo,
+// which -march=native compiles for; the first processor stands for all
+static string cpu_identity()
+{
+    static const char *const keys[] = {"vendor_id","cpu family","model","model name","stepping","flags",
+                                       "CPU implementer","CPU architecture","CPU variant","CPU part","Features","isa","uarch"};
+    FILE *f = fopen("/proc/cpuinfo","r");
+    if(f == nullptr)
+        return "";
+    string id;
+    char *line = nullptr;
+    size_t size = 0;
+    while(getline(&line,&size,f) > 0 && line[0] != '\n')
+    {
+        const char *colon = strchr(line,':');
+        if(colon == nullptr)
+            continue;
+        string key(line,colon-line);
+        key.erase(key.find_last_not_of(" \t")+1);
+        for(const char *k : keys)
+        {
+            if(key == k)
+                id += line;
+        }
+    }
+    free(line);
+    fclose(f);
+    return id;
+}
+
+bool JitKernel::load(const JitParams &p, const char *cache_dir, Logger &logger)
+{
+    string source = kernel_source;
+    replace(source,"@NX@",to_string(p.NX));
+    replace(source,"@NY@",to_string(p.NY));
+    replace(source,"@TILENX@",to_string(p.tile_nx));
+    replace(source,"@TILENY@",to_string(p.tile_ny));
+    replace(source,"@TAUINV@",hex(p.tauinv));
+    replace(source,"@OMTAUINV@",hex(p.omtauinv));
+    replace(source,"@W0@",hex(p.w0));
+    replace(source,"@WS@",hex(p.ws));
+    replace(source,"@WD@",hex(p.wd));
+    replace(source,"@RHOLIMIT@",hex(p.rho_limit));
+    replace(source,"@USQLIMIT@",hex(p.usq_limit));
+    replace(source,"@FBSIZE@",to_string(sizeof(FlowBounds)));
+    replace(source,"@FBALIGN@",to_string(alignof(FlowBounds)));
+    replace(source,"@FBRHOMIN@",to_string(offsetof(FlowBounds,rho_min)));
+    replace(source,"@FBUSQMAX@",to_string(offsetof(FlowBounds,usq_max)));
+    replace(source,"@FBVIOLATIONS@",to_string(offsetof(FlowBounds,violations)));
+    replace(source,"@FBNONFINITE@",to_string(offsetof(FlowBounds,nonfinite)));
+
+    const char *cxx = getenv("CXX");
+    if(cxx == nullptr || *cxx == '\0')
+        cxx = "c++";
+
+    string dir;
+    if(cache_dir != nullptr)
+        dir = cache_dir;
+    else if(const char *xdg = getenv("XDG_CACHE_HOME"); xdg != nullptr && *xdg != '\0')
+        dir = string(xdg)+"/lbm-jit";
+    else if(const char *home = getenv("HOME"); home != nullptr && *home != '\0')
+        dir = string(home)+"/.cache/lbm-jit";
+    else
+        dir = "/tmp/lbm-jit";
+    if(!make_dirs(dir))
+    {
+        logger.info("Warning: cannot create the JIT cache %s, using the built-in kernel",dir.c_str());
+        return false;
+    }
+
+    // the key covers every baked-in parameter, the tile sizes too, the
+    // compiler command and version, and the processor of -march=native, so a
+    // cache shared by several machines or compilers never hands out a
+    // foreign kernel
+    string version;
+    if(!run({cxx,"--version"},&version))
+    {
+        logger.info("Warning: cannot run %s, using the built-in kernel",cxx);
+        return false;
+    }
+    string key = source+cxx+version+cpu_identity();
+    for(const char *flag : jit_flags)
+        key += flag;
+    char name[64];
+    snprintf(name,sizeof(name),"/lbm_%016llx",fnv1a(key));
+    const string so = dir+name+".so";
+
+    bool cached = access(so.c_str(),R_OK) == 0;
+    if(!cached)
+    {
+        // compile from and to private names and rename, so concurrent runs
+        // never overwrite each other's source or load a half-written object
+        const string tmp = so+"."+to_string(getpid());
+        const string src = tmp+".cpp";
+        FILE *f = fopen(src.c_str(),"w");
+        if(f == nullptr || fputs(source.c_str(),f) < 0 || fclose(f) != 0)
+        {
+            if(f != nullptr)
+                unlink(src.c_str());
+            logger.info("Warning: cannot write %s, using the built-in kernel",src.c_str());
+            return false;
+        }
+        const bool compiled = compile(cxx,src,tmp);
+        unlink(src.c_str());
+        if(!compiled || rename(tmp.c_str(),so.c_str()) != 0)
+        {
+            unlink(tmp.c_str());
+            logger.info("Warning: compiling the JIT kernel with %s failed, using the built-in kernel",cxx);
+            return false;
+        }
+    }
+
+    handle = dlopen(so.c_str(),RTLD_NOW|RTLD_LOCAL);
+    if(handle == nullptr)
+    {
+        logger.info("Warning: %s, using the built-in kernel",dlerror());
+        return false;
+    }
+    fn = reinterpret_cast<Fn>(dlsym(handle,"lbm_jit_kernel"));
+    if(fn == nullptr)
+    {
+        logger.info("Warning: %s has no kernel, using the built-in kernel",so.c_str());
+        dlclose(handle);
+        handle = nullptr;
+        return false;
+    }
+    logger.info("       jit kernel: %s%s",so.c_str(),cached ? " (cached)" : "");
+    return true;
+}
+
+void JitKernel::unload()
+{
+    if(handle != nullptr)
+        dlclose(handle);
+    handle = nullptr;
+    fn = nullptr;
+}
+
+JitKernel::~JitKernel()
+{
+    unload();
+}
@@ -0,0 +1,59 @@
+#ifndef __JIT_H
+#define __JIT_H
+
+#include <cstddef>
+
+class Logger;
+struct FlowBounds;
+
+// everything that is baked into a specialised kernel
+struct JitParams {
+    size_t NX, NY;
+    size_t tile_nx, tile_ny;        // NX x NY for a sweep
+    double tauinv, omtauinv;
+    double w0, ws, wd;
+    double rho_limit, usq_limit;   // watchdog limits
+};
+
+/**
+ * Stream-collide kernel specialised at run time.
+ *
+ * load() writes a translation unit with the grid size, the tile of the
+ * traversal, the population layout (f[x][y][8], y contiguous), the BGK constants and the watchdog
+ * limits as compile-time constants, compiles it into a shared object with
+ * the system compiler ($CXX or c++) for the native processor and dlopens
+ * it. The object is cached under a hash of the generated source, the
+ * compiler command and version and the processor model and features, so a
+ * configuration is compiled only once per machine. The generated source
+ * checks its copy of FlowBounds against the solver's at compile time.
+ * Floating point contraction is disabled, the specialised kernel gives the
+ * same results as the built-in one.
+ */
+class JitKernel {
+public:
+    // pull-streaming update of the rows ybegin <= y < yend, as stream_collide_save
+    using Fn = void (*)(double *f0, const double *f1, double *f2, double *r, double *u, double *v,
+                        int save, FlowBounds *bounds, size_t ybegin, size_t yend);
+
+    JitKernel() = default;
+    ~JitKernel();
+
+    JitKernel(const JitKernel&) = delete;
+    JitKernel& operator=(const JitKernel&) = delete;
+
+    // generate, compile unless cached, and load; cache_dir may be null for
+    // $XDG_CACHE_HOME/lbm-jit or ~/.cache/lbm-jit; returns false and logs the
+    // reason when no kernel is available
+    bool load(const JitParams &p, const char *cache_dir, Logger &logger);
+
+    Fn get() const { return fn; }
+
+    // drop the loaded kernel, e.g. before loading one with other parameters
+    void unload();
+
+private:
+    void *handle = nullptr;
+    Fn fn = nullptr;
+};
+
+#endif /* __JIT_H */
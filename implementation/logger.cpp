@@ -0,0 +1,267 @@
+#include <cstdarg>
+#include <cstring>
+#include <new>
+#include "logger.h"
+
+using namespace std;
+
+static size_t round_up_pow2(size_t n)
+{
+    size_t p = 2;
+    while(p < n)
+        p *= 2;
+    return p;
+}
+
+Logger::Logger(FILE *o, FILE *e, LogFormat fmt, size_t capacity)
+    : out(o), err(e), format(fmt), mask(round_up_pow2(capacity)-1), cells(mask+1)
+{
+    for(size_t i = 0; i <= mask; ++i)
+        cells[i].seq.store(i,memory_order_relaxed);
+    thread = std::thread(&Logger::loop,this);
+}
+
+Logger::~Logger()
+{
+    // the writer stops at this record, after all records before it
+    size_t pos;
+    Record &r = claim(pos);
+    r.kind = Kind::Stop;
+    r.long_text = nullptr;
+    publish(pos);
+    thread.join();
+}
+
+Logger::Record& Logger::claim(size_t &pos)
+{
+    // bounded MPMC queue after D. Vyukov; a cell is free for position pos
+    // when its sequence number equals pos
+    pos = enqueue_pos.load(memory_order_relaxed);
+    for(;;)
+    {
+        Cell &c = cells[pos & mask];
+        size_t seq = c.seq.load(memory_order_acquire);
+        ptrdiff_t dif = ptrdiff_t(seq)-ptrdiff_t(pos);
+        if(dif == 0)
+        {
+            if(enqueue_pos.compare_exchange_weak(pos,pos+1,memory_order_relaxed))
+                return c.rec;
+        }
+        else if(dif < 0)
+        {
+            // queue full, wait for the writer to free the cell
+            c.seq.wait(seq,memory_order_acquire);
+            pos = enqueue_pos.load(memory_order_relaxed);
+        }
+        else
+        {
+            pos = enqueue_pos.load(memory_order_relaxed);
+        }
+    }
+}
+
+void Logger::publish(size_t pos)
+{
+    // wakes the writer if it sleeps on this cell
+    Cell &c = cells[pos & mask];
+    c.seq.store(pos+1,memory_order_release);
+    c.seq.notify_all();
+}
+
+void Logger::text(Kind kind, const char *fmt, va_list args)
+{
+    size_t pos;
+    Record &r = claim(pos);
+    r.kind = kind;
+    r.event = nullptr;
+    r.long_text = nullptr;
+    r.step = 0;
+    r.nfields = 0;
+
+    va_list again;
+    va_copy(again,args);
+    int n = vsnprintf(r.text,max_text,fmt,args);
+    if(n >= int(max_text))
+    {
+        r.long_text = new char[n+1];
+        vsnprintf(r.long_text,n+1,fmt,again);
+    }
+    va_end(again);
+
+    publish(pos);
+}
+
+void Logger::info(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args,fmt);
+    text(Kind::Text,fmt,args);
+    va_end(args);
+}
+
+void Logger::error(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args,fmt);
+    text(Kind::Error,fmt,args);
+    va_end(args);
+    flush();
+}
+
+void Logger::data(const char *event, unsigned long long step, initializer_list<LogField> fields)
+{
+    size_t pos;
+    Record &r = claim(pos);
+    r.kind = Kind::Data;
+    r.event = event;
+    r.long_text = nullptr;
+    r.step = step;
+    r.nfields = 0;
+    for(const LogField &f : fields)
+    {
+        if(r.nfields == max_fields)
+            break;
+        r.fields[r.nfields++] = f;
+    }
+    r.text[0] = '\0';
+
+    publish(pos);
+}
+
+void Logger::flush()
+{
+    size_t target = enqueue_pos.load(memory_order_acquire);
+    size_t flushed;
+    while((flushed = flushed_pos.load(memory_order_acquire)) < target)
+        flushed_pos.wait(flushed,memory_order_acquire);
+}
+
+void Logger::after_fork()
+{
+    // the handle names a thread of the parent, see ThreadPool::after_fork
+    new (&thread) std::thread(&Logger::loop,this);
+}
+
+size_t Logger::queue_depth() const
+{
+    size_t e = enqueue_pos.load(memory_order_relaxed);
+    size_t d = dequeue_pos.load(memory_order_relaxed);
+    return e > d ? e-d : 0;
+}
+
+static void write_json_string(FILE *out, const char *s)
+{
+    fputc('"',out);
+    for(; *s; ++s)
+    {
+        unsigned char c = *s;
+        if(c == '"' || c == '\\')
+        {
+            fputc('\\',out);
+            fputc(c,out);
+        }
+        else if(c < 0x20)
+        {
+            fprintf(out,"\\u%04x",c);
+        }
+        else
+        {
+            fputc(c,out);
+        }
+    }
+    fputc('"',out);
+}
+
+void Logger::write(const Record &r)
+{
+    const char *message = r.long_text != nullptr ? r.long_text : r.text;
+    FILE *f = out;
+    if(r.kind == Kind::Error)
+    {
+        // after the lines written so far
+        fflush(out);
+        f = err;
+    }
+
+    if(format == LogFormat::CSV)
+    {
+        if(r.kind == Kind::Error)
+        {
+            fprintf(f,"Error: %s",message);
+        }
+        else if(r.kind == Kind::Text)
+        {
+            fputs(message,f);
+        }
+        else
+        {
+            fprintf(f,"%llu",r.step);
+            for(unsigned int i = 0; i < r.nfields; ++i)
+                fprintf(f,",%g",r.fields[i].value);
+        }
+        fputc('\n',f);
+        return;
+    }
+
+    if(r.kind != Kind::Data)
+    {
+        fputs(r.kind == Kind::Error ? "{\"event\":\"error\",\"message\":" : "{\"event\":\"info\",\"message\":",f);
+        write_json_string(f,message);
+    }
+    else
+    {
+        fputs("{\"event\":",f);
+        write_json_string(f,r.event);
+        fprintf(f,",\"step\":%llu",r.step);
+        for(unsigned int i = 0; i < r.nfields; ++i)
+        {
+            fputc(',',f);
+            write_json_string(f,r.fields[i].name);
+            fprintf(f,":%.17g",r.fields[i].value);
+        }
+    }
+    fputs("}\n",f);
+}
+
+void Logger::loop()
+{
+    size_t pos = dequeue_pos.load(memory_order_relaxed);
+    bool dirty = false;
+    bool last = false;
+    for(;;)
+    {
+        Cell &c = cells[pos & mask];
+        size_t seq = c.seq.load(memory_order_acquire);
+        if(seq == pos+1)
+        {
+            last = c.rec.kind == Kind::Stop;
+            if(!last)
+            {
+                write(c.rec);
+                dirty = true;
+            }
+            delete[] c.rec.long_text;
+            c.seq.store(pos+mask+1,memory_order_release);
+            c.seq.notify_all();
+            dequeue_pos.store(++pos,memory_order_release);
+            if(!last)
+                continue;
+        }
+
+        // queue empty: flush what was written, then idle
+        if(dirty)
+        {
+            fflush(out);
+            fflush(err);
+            dirty = false;
+        }
+        flushed_pos.store(pos,memory_order_release);
+        flushed_pos.notify_all();
+        if(last)
+            return;
+
+        // sleep until the record at pos is published; it may have been
+        // claimed already
+        c.seq.wait(seq,memory_order_acquire);
+    }
+}
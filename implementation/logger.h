@@ -0,0 +1,106 @@
+#ifndef __LOGGER_H
+#define __LOGGER_H
+
+#include <atomic>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdio>
+#include <initializer_list>
+#include <thread>
+#include <vector>
+
+enum class LogFormat { CSV, JSON };
+
+// a named value of a data record; names must be string literals
+struct LogField {
+    const char *name;
+    double value;
+};
+
+/**
+ * Asynchronous structured logger.
+ *
+ * Producers (any thread) put fixed-size records into a bounded lock-free
+ * multi-producer queue and return; they never write or flush. Data records
+ * are copied as they are, text messages are printed into the record by the
+ * producer (a message longer than max_text goes to the heap instead and is
+ * freed by the writer, so nothing is cut off). A background thread formats
+ * the records as CSV or JSON lines and writes them, flushing only when the
+ * queue runs empty; then it sleeps until the next record is published.
+ * Every line is written by the background thread in one piece, so output of
+ * different threads never interleaves. A full queue makes producers wait;
+ * records are never dropped.
+ *
+ * CSV data records keep the historic format "step,value,value,...", text
+ * records are written as they are. In JSON every record is one object.
+ * Errors go to the error stream, "Error: message" or an object with the
+ * event "error", after everything logged before them.
+ */
+class Logger {
+public:
+    static const unsigned int max_fields = 8;
+    static const size_t max_text = 160;
+
+    Logger(FILE *out, FILE *err, LogFormat fmt, size_t capacity = 1024);
+    ~Logger();
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    // free text message, printf-style
+    void info(const char *fmt, ...) __attribute__((format(printf,2,3)));
+
+    // error message, printf-style; returns once it has been written, since
+    // an exit usually follows
+    void error(const char *fmt, ...) __attribute__((format(printf,2,3)));
+
+    // structured record of up to max_fields values
+    void data(const char *event, unsigned long long step, std::initializer_list<LogField> fields);
+
+    // wait until everything logged so far has been written and flushed
+    void flush();
+
+    // records queued but not yet written
+    size_t queue_depth() const;
+
+    // in a child created by fork() after flush(): start a new writer thread,
+    // the old one only exists in the parent
+    void after_fork();
+
+private:
+    enum class Kind : unsigned char { Text, Error, Data, Stop };
+
+    struct Record {
+        Kind kind;
+        const char *event;        // data records only
+        char *long_text;          // text beyond max_text, owned by the record
+        unsigned long long step;
+        unsigned int nfields;
+        LogField fields[max_fields];
+        char text[max_text];
+    };
+
+    struct alignas(64) Cell {
+        std::atomic<size_t> seq;
+        Record rec;
+    };
+
+    Record& claim(size_t &pos);
+    void publish(size_t pos);
+    void text(Kind kind, const char *fmt, va_list args);
+    void write(const Record &r);
+    void loop();
+
+    FILE *const out;
+    FILE *const err;
+    const LogFormat format;
+    const size_t mask;
+    std::vector<Cell> cells;
+
+    alignas(64) std::atomic<size_t> enqueue_pos{0};
+    alignas(64) std::atomic<size_t> dequeue_pos{0};
+    std::atomic<size_t> flushed_pos{0};
+    std::thread thread;
+};
+
+#endif /* __LOGGER_H */
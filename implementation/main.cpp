@@ -11,16 +11,113 @@
  *
  */
 
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <exception>
 #include <iostream>
+#include <optional>
+#include <utility>
+#include <vector>
 
 using namespace std;
 
 #  include <mdspan>
 #include <ostream>
 
+#include "alloc_audit.h"
+#include "benchmark.h"
+#include "checkpoint.h"
+#include "ensemble.h"
 #include "seconds.h"
+#include "storage.h"
 #include "LBM.h"
+#include "metrics.h"
+#include "pipeline.h"
+#include "schedule.h"
+
+// a grid size from the command line; exits unless it is a positive integer
+static size_t parse_size(const char *s, const char *name)
+{
+    char *end;
+    errno = 0;
+    unsigned long long n = strtoull(s,&end,10);
+    if(end == s || *end != '\0' || *s == '-' || errno == ERANGE || n == 0)
+    {
+        fprintf(stderr,"Error: %s must be a positive integer, not \"%s\"\n",name,s);
+        exit(-1);
+    }
+    return n;
+}
+
+// map the fields in the backing directory and write the last node through
+// the indexing of the kernels, then check that it landed at the end of
+// every field; on a grid of more than 2^32 nodes this shows that no index
+// wraps, and the sparse files only materialise the pages touched
+static bool check_grid(LBM &lbm, const char *backing_dir)
+{
+    const size_t m = lbm.ndir-1;
+    FieldBuffer ptr_f0(lbm.mem_size_0dir/sizeof(double),backing_dir);
+    FieldBuffer ptr_f1(lbm.mem_size_n0dir/sizeof(double),backing_dir);
+    FieldBuffer ptr_rho(lbm.mem_size_scalar/sizeof(double),backing_dir);
+    auto f0 = mdspan(ptr_f0.get(),lbm.NX,lbm.NY);
+    auto f1 = mdspan(ptr_f1.get(),lbm.NX,lbm.NY,m);
+    auto rho = mdspan(ptr_rho.get(),lbm.NX,lbm.NY);
+
+    const size_t x = lbm.NX-1, y = lbm.NY-1;
+    double r, u, v;
+    lbm.taylor_green_cfp(0,x,y,&r,&u,&v);
+    rho[x,y] = r;
+    lbm.equilibrium_node(x,y,r,u,v,f0,f1);
+
+    bool ok = &rho[x,y] == ptr_rho.get()+ptr_rho.size()-1 && rho[x,y] == r && &f0[x,y] == ptr_f0.get()+ptr_f0.size()-1 && f0[x,y] > 0.0;
+    for(size_t d = 0; d < m; ++d)
+        ok = ok && f1[x,y,d] > 0.0 && &f1[x,y,d] == ptr_f1.get()+ptr_f1.size()-m+d;
+    lbm.logger.info("Grid check of %zux%zu (%zu nodes, %zu populations): %s",lbm.NX,lbm.NY,lbm.NX*lbm.NY,ptr_f1.size(),ok ? "passed" : "FAILED");
+    return ok;
+}
+
+// write files through the io_uring backend in page-sized chunks, far more
+// per file than the ring has entries, then read them back; the ring has to
+// be drained and refilled while a file is being queued
+static bool check_output(LBM &lbm, const char *dir)
+{
+    const size_t n = lbm.NX*lbm.NY;
+    const unsigned int files = 4;
+    OutputWriter writer(OutputBackend::IoUring,OutputWriter::alignment,lbm.logger);
+    Arena arena;
+    arena.reserve(writer.footprint(n*sizeof(double)));
+    writer.allocate(arena,n*sizeof(double));
+    char path[4096];
+    for(unsigned int k = 0; k < files; ++k)
+    {
+        double *values = writer.buffer();
+        for(size_t i = 0; i < n; ++i)
+            values[i] = double(k*n+i);
+        snprintf(path,sizeof(path),"%s/output_check%u.bin",dir,k);
+        writer.write(path);
+    }
+    writer.flush();
+
+    bool ok = true;
+    vector<double> values(n+1);
+    for(unsigned int k = 0; k < files && ok; ++k)
+    {
+        snprintf(path,sizeof(path),"%s/output_check%u.bin",dir,k);
+        FILE *f = fopen(path,"rb");
+        ok = f != nullptr && fread(values.data(),sizeof(double),n+1,f) == n;
+        for(size_t i = 0; i < n && ok; ++i)
+            ok = values[i] == double(k*n+i);
+        if(f != nullptr)
+            fclose(f);
+        remove(path);
+    }
+    lbm.logger.info("Output check of %u files of %zu chunks: %s",files,(n*sizeof(double)+OutputWriter::alignment-1)/OutputWriter::alignment,ok ? "passed" : "FAILED");
+    return ok;
+}
 
 int main(int argc, char* argv[])
 {
@@ -39,19 +136,136 @@ int main(int argc, char* argv[])
         std::cout << std::endl;
     }
     */
-    auto lbm = LBM();
-    printf("Simulating Taylor-Green vortex decay\n");
-    printf("      domain size: %ux%u\n",lbm.NX,lbm.NY);
-    printf("               nu: %g\n",lbm.nu);
-    printf("              tau: %g\n",lbm.tau);
-    printf("            u_max: %g\n",lbm.u_max);
-    printf("             rho0: %g\n",lbm.rho0);
-    printf("        timesteps: %u\n",lbm.NSTEPS);
-    printf("       save every: %u\n",lbm.NSAVE);
-    printf("    message every: %u\n",lbm.NMSG);
-    printf("\n");
-
-    double bytesPerMiB = 1024.0*1024.0;
+    // usage: lattice_boltzmann_uni_praktikum [--benchmark] [--check-grid] [--check-output] [--restart checkpoint] [--stream path]
+    //        [--rho file] [--ux file] [--uy file] [--solid file] [--stl file] [NX NY [backing_dir]]
+    // with a backing directory all fields are mapped from sparse files there,
+    // which allows grids larger than main memory; --benchmark times every
+    // kernel variant instead of running the simulation; --check-grid only
+    // checks the indexing of a grid in the backing directory; --check-output
+    // only checks the io_uring output of files of the grid into the backing
+    // directory; --restart continues
+    // from a checkpoint file, whatever configuration wrote it; --stream sends
+    // the saved moments to a consumer at a Unix socket or FIFO; --rho, --ux
+    // and --uy read the initial fields and --solid a mask of solid nodes from
+    // raw or .npy files, see initial.h, --stl voxelises an obstacle from a
+    // triangulated surface, see voxel.h (a restart needs the mask again)
+    bool benchmark = false;
+    bool grid_check = false;
+    bool output_check = false;
+    const char *restart = nullptr;
+    const char *stream = nullptr;
+    InitialFiles initial;
+    int arg = 1;
+    for(; arg < argc && strncmp(argv[arg],"--",2) == 0; ++arg)
+    {
+        if(strcmp(argv[arg],"--benchmark") == 0)
+            benchmark = true;
+        else if(strcmp(argv[arg],"--check-grid") == 0)
+            grid_check = true;
+        else if(strcmp(argv[arg],"--check-output") == 0)
+            output_check = true;
+        else if(strcmp(argv[arg],"--restart") == 0 && arg+1 < argc)
+            restart = argv[++arg];
+        else if(strcmp(argv[arg],"--stream") == 0 && arg+1 < argc)
+            stream = argv[++arg];
+        else if(strcmp(argv[arg],"--rho") == 0 && arg+1 < argc)
+            initial.rho = argv[++arg];
+        else if(strcmp(argv[arg],"--ux") == 0 && arg+1 < argc)
+            initial.ux = argv[++arg];
+        else if(strcmp(argv[arg],"--uy") == 0 && arg+1 < argc)
+            initial.uy = argv[++arg];
+        else if(strcmp(argv[arg],"--solid") == 0 && arg+1 < argc)
+            initial.solid = argv[++arg];
+        else if(strcmp(argv[arg],"--stl") == 0 && arg+1 < argc)
+            initial.stl = argv[++arg];
+        else
+        {
+            fprintf(stderr,"Error: unknown option %s\n",argv[arg]);
+            exit(-1);
+        }
+    }
+    const size_t nx = argc > arg+1 ? parse_size(argv[arg],"NX") : 0;
+    const size_t ny = argc > arg+1 ? parse_size(argv[arg+1],"NY") : 0;
+    // the populations of all nodes must be addressable
+    if(nx > 0 && ny > SIZE_MAX/nx/(8*sizeof(double)))
+    {
+        fprintf(stderr,"Error: a %zux%zu grid is too large to address\n",nx,ny);
+        exit(-1);
+    }
+    auto lbm = nx > 0 ? LBM(nx,ny) : LBM();
+    const char *backing_dir = argc > arg+2 ? argv[arg+2] : nullptr;
+    if(grid_check)
+    {
+        if(backing_dir == nullptr)
+        {
+            lbm.logger.error("--check-grid needs a backing directory.");
+            exit(-1);
+        }
+        try
+        {
+            return check_grid(lbm,backing_dir) ? 0 : -1;
+        }
+        catch(const exception &e)
+        {
+            lbm.logger.error("%s",e.what());
+            exit(-1);
+        }
+    }
+    if(output_check)
+    {
+        if(backing_dir == nullptr)
+        {
+            lbm.logger.error("--check-output needs a backing directory.");
+            exit(-1);
+        }
+        try
+        {
+            return check_output(lbm,backing_dir) ? 0 : -1;
+        }
+        catch(const exception &e)
+        {
+            lbm.logger.error("%s",e.what());
+            exit(-1);
+        }
+    }
+    if(stream != nullptr)
+        lbm.streamPath = stream;
+    lbm.initial = initial;
+    lbm.logger.info("Simulating Taylor-Green vortex decay");
+    lbm.logger.info("      domain size: %zux%zu",lbm.NX,lbm.NY);
+    lbm.logger.info("               nu: %g",lbm.nu);
+    lbm.logger.info("              tau: %g",lbm.tau);
+    lbm.logger.info("            u_max: %g",lbm.u_max);
+    lbm.logger.info("             rho0: %g",lbm.rho0);
+    if(lbm.kT > 0.0)
+        lbm.logger.info("               kT: %g (seed %llu)",lbm.kT,lbm.noiseSeed);
+    lbm.logger.info("        timesteps: %u",lbm.NSTEPS);
+    lbm.logger.info("       save every: %u",lbm.NSAVE);
+    if(lbm.streamPath != nullptr)
+        lbm.logger.info("        stream to: %s",lbm.streamPath);
+    lbm.logger.info("    message every: %u",lbm.NMSG);
+    lbm.logger.info("          threads: %u",lbm.pool.size());
+    lbm.logger.info("        traversal: %s",traversal_name(lbm.traversal));
+    lbm.logger.info("        streaming: %s",streaming_name(lbm.streaming));
+    if(lbm.traversal == Traversal::Tiled)
+        lbm.logger.info("            tiles: %zux%zu",lbm.tile_nx,lbm.tile_ny);
+    if(lbm.traversal == Traversal::Wavefront)
+        lbm.logger.info("  wavefront lines: %zu",lbm.wave_lines);
+    lbm.logger.info("%s","");
+
+    if(lbm.streaming == Streaming::Push && lbm.temporal())
+    {
+        lbm.logger.error("push streaming needs the sweep or tiled traversal.");
+        exit(-1);
+    }
+    if(lbm.ensembleMembers > 0 && backing_dir != nullptr)
+    {
+        lbm.logger.error("ensemble members cannot share mapped fields, run without a backing directory.");
+        exit(-1);
+    }
+
+    lbm.prepare_jit();
+
     double bytesPerGiB = 1024.0*1024.0*1024.0;
 
     /*
@@ -66,84 +280,188 @@ int main(int argc, char* argv[])
     // ux and uy are two dimensional fields respectivly
     // the field f is of the form f[N_x][N_y][q]
 
-    auto ptr_f0 = make_unique<double[]>(lbm.mem_size_0dir);
-    auto ptr_f1 = make_unique<double[]>(lbm.mem_size_n0dir);
-    auto ptr_f2 = make_unique<double[]>(lbm.mem_size_n0dir);
-    auto ptr_rho =make_unique<double[]>(lbm.mem_size_scalar);
-    auto ptr_ux = make_unique<double[]>(lbm.mem_size_scalar);
-    auto ptr_uy = make_unique<double[]>(lbm.mem_size_scalar);
-
-
-    //size_t total_mem_bytes = lbm.mem_size_0dir + 2*lbm.mem_size_n0dir + 3*lbm.mem_size_scalar;
+    // refuse the run up front if it cannot fit
+    MemoryConfig memory = lbm.memory_config(backing_dir != nullptr);
+    if(lbm.admissionCheck && !admit(memory,lbm.logger))
+    {
+        exit(-1);
+    }
+    size_t total_mem_bytes = plan_memory(memory).total();
 
-    /*if(f0 == NULL || f1 == NULL || f2 == NULL || rho == NULL || ux == NULL || uy == NULL)
+    // a backing directory that cannot hold the files, or memory that runs
+    // out despite the plan, ends the run with an error line
+    optional<FieldBuffer> ptr_f0, ptr_f1, ptr_f2, ptr_rho, ptr_ux, ptr_uy;
+    // one byte per node, rounded up to whole doubles
+    optional<FieldBuffer> ptr_solid;
+    try
+    {
+        ptr_f0.emplace(lbm.mem_size_0dir/sizeof(double),backing_dir);
+        ptr_f1.emplace(lbm.mem_size_n0dir/sizeof(double),backing_dir);
+        ptr_f2.emplace(lbm.mem_size_n0dir/sizeof(double),backing_dir);
+        ptr_rho.emplace(lbm.mem_size_scalar/sizeof(double),backing_dir);
+        ptr_ux.emplace(lbm.mem_size_scalar/sizeof(double),backing_dir);
+        ptr_uy.emplace(lbm.mem_size_scalar/sizeof(double),backing_dir);
+        if(lbm.initial.masked())
+            ptr_solid.emplace((lbm.NX*lbm.NY+sizeof(double)-1)/sizeof(double),backing_dir);
+        lbm.allocate_buffers();
+    }
+    catch(const exception &e)
     {
-        fprintf(stderr,"Error: unable to allocate required memory (%.1f MiB).\n",total_mem_bytes/bytesPerMiB);
+        lbm.logger.error("%s",e.what());
         exit(-1);
-    }*/
+    }
+
 // TODO init with static extend<> ?
     auto m = lbm.ndir-1;
-    auto f0 = mdspan(ptr_f0.get(),lbm.NX,lbm.NY);
-    auto f1 = mdspan(ptr_f1.get(),lbm.NX,lbm.NY,m);
-    auto f2 = mdspan(ptr_f2.get(),lbm.NX,lbm.NY,m);
-    auto rho = mdspan(ptr_rho.get(),lbm.NX,lbm.NY);
-    auto ux = mdspan(ptr_ux.get(),lbm.NX,lbm.NY);
-    auto uy = mdspan(ptr_uy.get(),lbm.NX,lbm.NY);
-    // compute Taylor-Green flow at t=0 
-    // to initialise rho, ux, uy fields.
-    lbm.taylor_green(0,rho,ux,uy);
-    
-    // initialise f1 as equilibrium for rho, ux, uy
-    lbm.init_equilibrium(f0,f1,rho,ux,uy);
+    auto f0 = mdspan(ptr_f0->get(),lbm.NX,lbm.NY);
+    auto f1 = mdspan(ptr_f1->get(),lbm.NX,lbm.NY,m);
+    auto f2 = mdspan(ptr_f2->get(),lbm.NX,lbm.NY,m);
+    auto rho = mdspan(ptr_rho->get(),lbm.NX,lbm.NY);
+    auto ux = mdspan(ptr_ux->get(),lbm.NX,lbm.NY);
+    auto uy = mdspan(ptr_uy->get(),lbm.NX,lbm.NY);
+    if(ptr_solid)
+        lbm.solid = mdspan(reinterpret_cast<unsigned char*>(ptr_solid->get()),lbm.NX,lbm.NY);
+    if(lbm.initial.any())
+    {
+        // read rho, ux, uy and the mask from files or voxelise the obstacle,
+        // converted in parallel straight into the equilibrium populations
+        try
+        {
+            load_initial(lbm,f0,f1,f2,rho,ux,uy);
+        }
+        catch(const exception &e)
+        {
+            lbm.logger.error("%s",e.what());
+            exit(-1);
+        }
+    }
+    else
+    {
+        // compute Taylor-Green flow at t=0 
+        // to initialise rho, ux, uy fields.
+        lbm.taylor_green(0,rho,ux,uy);
+        
+        // initialise f1 as equilibrium for rho, ux, uy
+        lbm.init_equilibrium(f0,f1,rho,ux,uy);
+    }
 
+    // or continue from a checkpoint, redistributed into this configuration
+    if(restart != nullptr)
+    {
+        try
+        {
+            load_checkpoint(lbm,restart,f0,f1,f2,rho,ux,uy);
+        }
+        catch(const exception &e)
+        {
+            lbm.logger.error("%s: %s",e.what(),restart);
+            exit(-1);
+        }
+    }
 
-    lbm.save_scalar("rho",rho,0);
-    lbm.save_scalar("ux", ux, 0);
-    lbm.save_scalar("uy", uy, 0);
+    // a restart continues the series and HDF5 files, a new run replaces them
+    if(lbm.time_step > 0)
+    {
+        lbm.series.resume();
+        lbm.hdf5.resume();
+    }
 
-    if(lbm.computeFlowProperties)
+    if(benchmark)
     {
-        lbm.report_flow_properties(0,rho,ux,uy);
+        run_benchmark(lbm,f0,f1,f2,rho,ux,uy);
+        return 0;
     }
+    lbm.prepare_streaming(f1,f2);
+
+    // with an ensemble the rest runs in every member, from the end of the
+    // shared spin-up; otherwise from step 0 or the restart step
+    const unsigned int first_step = lbm.ensembleMembers > 0 ? fork_ensemble(lbm,f0,f1,f2,rho,ux,uy) : lbm.time_step;
+
+    // analysis and output of the moments run concurrently with the solver
+    Pipeline pipeline(lbm,lbm.pipelineDepth);
+    pipeline.submit(first_step,true,lbm.computeFlowProperties,rho,ux,uy);
+
+    // restart points, written in the background
+    Checkpointer checkpoints(lbm);
+
+    // when to save: every NSAVE steps or, adaptive, when the flow changed;
+    // triggers request saves from the probed bounds, e.g.
+    //   schedule.add([](unsigned int t, const FlowBounds &b) { return b.rho_min < 0.99; });
+    OutputSchedule schedule(lbm,first_step,ux,uy);
+
+    // progress for operations, rewritten in the background
+    Metrics metrics(lbm.metricsFile,lbm.metricsInterval,first_step,lbm.NSTEPS,lbm.NX*lbm.NY,total_mem_bytes,&pipeline,&lbm.logger);
     
+    // with LBM_ALLOC_AUDIT, fail if the loop allocates after warm-up
+    AllocAudit audit(lbm.allocAuditWarmup);
+
     double start = seconds();
     
-    // main simulation loop; take NSTEPS time steps
-    for(unsigned int n = 0; n < lbm.NSTEPS; ++n)
+    // the output and checkpoint writers rethrow their errors in submit()
+    // and finish(); report them and stop
+    try
     {
-        bool save = (n+1)%lbm.NSAVE == 0;
-        bool msg  = (n+1)%lbm.NMSG == 0;
-        bool need_scalars = save || (msg && lbm.computeFlowProperties);
+        // main simulation loop; take NSTEPS time steps
+        // the temporal traversals fuse all steps up to the next save or probe,
+        // message, watchdog check or checkpoint
+        const unsigned int watch_every = lbm.watchdogInterval > 0 ? lbm.watchdogInterval : lbm.NSTEPS;
+        const unsigned int checkpoint_every = lbm.checkpointInterval > 0 ? lbm.checkpointInterval : lbm.NSTEPS;
+        for(unsigned int n = first_step, steps = 1; n < lbm.NSTEPS; n += steps)
+        {
+            if(lbm.temporal())
+                steps = min({lbm.NSTEPS-n,schedule.until(n),lbm.NMSG-n%lbm.NMSG,watch_every-n%watch_every,checkpoint_every-n%checkpoint_every});
+            bool save = schedule.save(n+steps);
+            bool msg  = (n+steps)%lbm.NMSG == 0;
+            bool check = lbm.watchdogInterval > 0 && (n+steps)%lbm.watchdogInterval == 0;
+            bool probe = schedule.probe(n+steps);
+            // the kernel tracks the bounds for the watchdog and the schedule
+            bool watch = check || probe;
+            bool need_scalars = save || (msg && lbm.computeFlowProperties);
         
-        // stream and collide from f1 storing to f2
-        // optionally compute and save moments
-        lbm.stream_collide_save(f0,f1,f2,rho,ux,uy,need_scalars);
+            // stream and collide from f1 storing to f2
+            // optionally compute and save moments
+            lbm.advance(f0,f1,f2,rho,ux,uy,steps,need_scalars,watch);
 
-        if(save)
-        {
-            lbm.save_scalar("rho",rho,n+1);
-            lbm.save_scalar("ux", ux, n+1);
-            lbm.save_scalar("uy", uy, n+1);
-        }
-        //TODO
-        // swap pointers
-        // double *temp = f1;
-        // f1 = f2;
-        // f2 = temp;
-        //
-        f1 = mdspan(ptr_f2.get(),lbm.NX,lbm.NY,m);
-        f2 = mdspan(ptr_f1.get(),lbm.NX,lbm.NY,m);
-        //ISSUE what happens with the old mdspan objects?
-        if(msg)
-        {
-            if(lbm.computeFlowProperties)
+            if(need_scalars)
+            {
+                pipeline.submit(n+steps,save,msg && lbm.computeFlowProperties,rho,ux,uy);
+            }
+            // swap pointers; an even number of steps ends in f1 again
+            if(steps%2 == 1)
+                swap(f1,f2);
+            // stop an unstable run instead of computing NaNs until NSTEPS
+            if(check && !lbm.check_stability(n+steps))
+            {
+                // finish the output so far, then dump the populations in the
+                // checkpoint format for a post-mortem or a restart
+                pipeline.finish();
+                checkpoints.finish();
+                char dump[64];
+                snprintf(dump,sizeof(dump),"watchdog%u.lbm",n+steps);
+                save_checkpoint(lbm,dump,n+steps,f0,f1);
+                lbm.logger.flush();
+                exit(-1);
+            }
+            const FlowBounds bounds = probe ? lbm.flow_bounds() : FlowBounds{};
+            schedule.update(n+steps,save,probe ? &bounds : nullptr);
+            if(lbm.checkpointInterval > 0 && (n+steps)%lbm.checkpointInterval == 0)
+                checkpoints.submit(n+steps,f0,f1);
+            metrics.step(n+steps);
+            audit.step(n+steps);
+            if(msg)
             {
-                lbm.report_flow_properties(n+1,rho,ux,uy);
+                if(!lbm.quiet)
+                    lbm.logger.info("completed timestep %d",n+steps);
             }
-            
-            if(!lbm.quiet)
-                printf("completed timestep %d\n",n+1);
         }
+        // wait for outstanding analysis and output
+        pipeline.finish();
+        checkpoints.finish();
+    }
+    catch(const exception &e)
+    {
+        lbm.logger.error("%s",e.what());
+        exit(-1);
     }
     double end = seconds();
     double runtime = end-start;
@@ -152,19 +470,19 @@ int main(int argc, char* argv[])
     size_t doubles_written = lbm.ndir;
     size_t doubles_saved = 3; // per node every NSAVE time steps
     
-    // note NX*NY overflows when NX=NY=65536
-    size_t nodes_updated = lbm.NSTEPS*size_t(lbm.NX*lbm.NY);
-    size_t nodes_saved   = (lbm.NSTEPS/lbm.NSAVE)*size_t(lbm.NX*lbm.NY);
+    // NX and NY are size_t, so NX*NY does not overflow for NX=NY=65536
+    size_t nodes_updated = size_t(lbm.NSTEPS-first_step)*lbm.NX*lbm.NY;
+    size_t nodes_saved   = size_t(schedule.saves())*lbm.NX*lbm.NY;
     double speed = nodes_updated/(1e6*runtime);
     
     double bandwidth = (nodes_updated*(doubles_read + doubles_written)+nodes_saved*(doubles_saved))*sizeof(double)/(runtime*bytesPerGiB);
     
-    printf(" ----- performance information -----\n");
-    //printf(" memory allocated: %.1f (MiB)\n",total_mem_bytes/bytesPerMiB);
-    printf("        timesteps: %u\n",lbm.NSTEPS);
-    printf("          runtime: %.3f (s)\n",runtime);
-    printf("            speed: %.2f (Mlups)\n",speed);
-    printf("        bandwidth: %.1f (GiB/s)\n",bandwidth);
+    lbm.logger.info(" ----- performance information -----");
+    lbm.logger.info(" memory allocated: %.1f (MiB)",total_mem_bytes/(1024.0*1024.0));
+    lbm.logger.info("        timesteps: %u",lbm.NSTEPS-first_step);
+    lbm.logger.info("          runtime: %.3f (s)",runtime);
+    lbm.logger.info("            speed: %.2f (Mlups)",speed);
+    lbm.logger.info("        bandwidth: %.1f (GiB/s)",bandwidth);
     
     // deallocate memory
     // free(f0);  free(f1); free(f2);
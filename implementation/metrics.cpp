@@ -0,0 +1,119 @@
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <unistd.h>
+#include "logger.h"
+#include "metrics.h"
+#include "pipeline.h"
+#include "seconds.h"
+
+using namespace std;
+
+Metrics::Metrics(const char *p, double i, unsigned long long first, unsigned long long n, size_t nn, size_t mb, Pipeline *pl, Logger *lg)
+    : path(p), interval(i), nsteps(n), nodes(nn), mem_bytes(mb), pipeline(pl), logger(lg), steps(first), last_step(first)
+{
+    start_time = seconds();
+    last_change_time = start_time;
+    if(path != nullptr)
+        thread = std::thread(&Metrics::loop,this);
+}
+
+Metrics::~Metrics()
+{
+    if(!thread.joinable())
+        return;
+    {
+        lock_guard<mutex> lock(m);
+        stop = true;
+    }
+    cv.notify_one();
+    thread.join();
+
+    // leave the final state behind
+    write(seconds());
+}
+
+void Metrics::loop()
+{
+    unique_lock<mutex> lock(m);
+    while(!stop)
+    {
+        lock.unlock();
+        write(seconds());
+        lock.lock();
+        cv.wait_for(lock,chrono::duration<double>(interval),[this]{ return stop; });
+    }
+}
+
+// resident set size in bytes, 0 if unknown
+static size_t resident_bytes()
+{
+    size_t size = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm","r");
+    if(f == nullptr)
+        return 0;
+    if(fscanf(f,"%zu %zu",&size,&resident) != 2)
+        resident = 0;
+    fclose(f);
+    return resident*size_t(sysconf(_SC_PAGESIZE));
+}
+
+void Metrics::write(double now)
+{
+    unsigned long long n = steps.load(memory_order_relaxed);
+    if(n != last_step)
+    {
+        last_step = n;
+        last_change_time = now;
+    }
+
+    // sliding window of the last samples
+    unsigned int slot = nsamples%window;
+    sample_time[slot] = now;
+    sample_step[slot] = n;
+    ++nsamples;
+    unsigned int oldest = nsamples > window ? nsamples%window : 0;
+
+    double dt = now-sample_time[oldest];
+    unsigned long long dn = n-sample_step[oldest];
+    double steps_per_second = dt > 0.0 ? dn/dt : 0.0;
+    double mlups = steps_per_second*nodes/1e6;
+    double eta = steps_per_second > 0.0 ? (nsteps-n)/steps_per_second : -1.0;
+
+    unsigned int snapshots = pipeline != nullptr ? pipeline->in_flight() : 0;
+    size_t log_records = logger != nullptr ? logger->queue_depth() : 0;
+
+    char tmp[512];
+    snprintf(tmp,sizeof(tmp),"%s.tmp",path);
+    FILE *f = fopen(tmp,"w");
+    if(f == nullptr)
+    {
+        failed();
+        return;
+    }
+    fprintf(f,"{\n");
+    fprintf(f,"  \"updated\": %lld,\n",(long long)time(nullptr));
+    fprintf(f,"  \"elapsed_s\": %.3f,\n",now-start_time);
+    fprintf(f,"  \"step\": %llu,\n",n);
+    fprintf(f,"  \"nsteps\": %llu,\n",nsteps);
+    fprintf(f,"  \"progress\": %.6f,\n",nsteps > 0 ? double(n)/nsteps : 1.0);
+    fprintf(f,"  \"mlups\": %.3f,\n",mlups);
+    fprintf(f,"  \"eta_s\": %.1f,\n",eta);
+    fprintf(f,"  \"since_last_step_s\": %.3f,\n",now-last_change_time);
+    fprintf(f,"  \"mem_planned_bytes\": %zu,\n",mem_bytes);
+    fprintf(f,"  \"mem_resident_bytes\": %zu,\n",resident_bytes());
+    fprintf(f,"  \"snapshots_in_flight\": %u,\n",snapshots);
+    fprintf(f,"  \"log_queue_depth\": %zu\n",log_records);
+    fprintf(f,"}\n");
+    const bool error = ferror(f) != 0;
+    if(fclose(f) != 0 || error || rename(tmp,path) != 0)
+        failed();
+}
+
+void Metrics::failed()
+{
+    if(warned || logger == nullptr)
+        return;
+    warned = true;
+    logger->info("Warning: cannot write the metrics file %s",path);
+}
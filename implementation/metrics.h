@@ -0,0 +1,69 @@
+#ifndef __METRICS_H
+#define __METRICS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+
+class Logger;
+class Pipeline;
+
+/**
+ * Live progress metrics of a run.
+ *
+ * The step loop only publishes the number of completed steps with a relaxed
+ * atomic store. A background thread samples it every interval seconds and
+ * atomically rewrites a small JSON file (write to path.tmp, then rename) with
+ * the current step, the speed over a sliding window of samples, the ETA, the
+ * memory footprint and the depth of the output queues. The file also holds
+ * the wall-clock time of the last update and the time since the step counter
+ * last moved, so stalled jobs are easy to spot. The window starts at
+ * first_step, the restart step, so a restarted run reports its own speed.
+ * A file that cannot be written is reported once through the logger.
+ */
+class Metrics {
+public:
+    static const unsigned int window = 16; // samples in the speed window
+
+    Metrics(const char *path, double interval, unsigned long long first_step, unsigned long long nsteps, size_t nodes, size_t mem_bytes, Pipeline *pipeline, Logger *logger);
+    ~Metrics();
+
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    // called by the step loop after step n completed
+    void step(unsigned long long n) { steps.store(n,std::memory_order_relaxed); }
+
+private:
+    void loop();
+    void write(double now);
+    void failed();
+
+    const char *const path;
+    const double interval;
+    const unsigned long long nsteps;
+    const size_t nodes;
+    const size_t mem_bytes;
+    Pipeline *const pipeline;
+    Logger *const logger;
+
+    std::atomic<unsigned long long> steps;
+
+    // ring of (time, step) samples; only touched by the metrics thread
+    double sample_time[window];
+    unsigned long long sample_step[window];
+    unsigned int nsamples = 0;
+    double start_time;
+    double last_change_time;
+    unsigned long long last_step;
+    bool warned = false;    // a write failed, logged once
+
+    std::mutex m;
+    std::condition_variable cv;
+    bool stop = false;
+    std::thread thread;
+};
+
+#endif /* __METRICS_H */
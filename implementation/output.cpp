@@ -0,0 +1,342 @@
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef LBM_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+#include "arena.h"
+#include "logger.h"
+#include "output.h"
+
+using namespace std;
+
+static size_t round_up(size_t n, size_t a)
+{
+    return (n+a-1)/a*a;
+}
+
+#ifdef LBM_HAVE_IO_URING
+
+// submission and completion queues of an io_uring instance, used through the
+// raw system calls
+struct OutputWriter::Ring {
+    static const unsigned int entries = 64;
+
+    int fd = -1;
+    bool fixed = false;         // buffers registered
+    unsigned int inflight = 0;  // submitted, not yet completed
+    unsigned int queued = 0;    // prepared, not yet submitted
+
+    void *sq_map = MAP_FAILED, *cq_map = MAP_FAILED, *sqe_map = MAP_FAILED;
+    size_t sq_bytes = 0, cq_bytes = 0, sqe_bytes = 0;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    io_uring_sqe *sqes;
+    io_uring_cqe *cqes;
+
+    ~Ring()
+    {
+        if(sqe_map != MAP_FAILED)
+            munmap(sqe_map,sqe_bytes);
+        if(cq_map != MAP_FAILED && cq_map != sq_map)
+            munmap(cq_map,cq_bytes);
+        if(sq_map != MAP_FAILED)
+            munmap(sq_map,sq_bytes);
+        if(fd >= 0)
+            close(fd);
+    }
+
+    bool setup()
+    {
+        io_uring_params p;
+        memset(&p,0,sizeof(p));
+        fd = syscall(__NR_io_uring_setup,entries,&p);
+        if(fd < 0)
+            return false;
+
+        sq_bytes = p.sq_off.array+p.sq_entries*sizeof(unsigned);
+        cq_bytes = p.cq_off.cqes+p.cq_entries*sizeof(io_uring_cqe);
+        if(p.features & IORING_FEAT_SINGLE_MMAP)
+            sq_bytes = cq_bytes = max(sq_bytes,cq_bytes);
+        sq_map = mmap(nullptr,sq_bytes,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,fd,IORING_OFF_SQ_RING);
+        if(sq_map == MAP_FAILED)
+            return false;
+        cq_map = p.features & IORING_FEAT_SINGLE_MMAP ? sq_map :
+                 mmap(nullptr,cq_bytes,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,fd,IORING_OFF_CQ_RING);
+        if(cq_map == MAP_FAILED)
+            return false;
+        sqe_bytes = p.sq_entries*sizeof(io_uring_sqe);
+        sqe_map = mmap(nullptr,sqe_bytes,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,fd,IORING_OFF_SQES);
+        if(sqe_map == MAP_FAILED)
+            return false;
+
+        char *sq = static_cast<char*>(sq_map), *cq = static_cast<char*>(cq_map);
+        sq_head  = reinterpret_cast<unsigned*>(sq+p.sq_off.head);
+        sq_tail  = reinterpret_cast<unsigned*>(sq+p.sq_off.tail);
+        sq_mask  = reinterpret_cast<unsigned*>(sq+p.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned*>(sq+p.sq_off.array);
+        cq_head  = reinterpret_cast<unsigned*>(cq+p.cq_off.head);
+        cq_tail  = reinterpret_cast<unsigned*>(cq+p.cq_off.tail);
+        cq_mask  = reinterpret_cast<unsigned*>(cq+p.cq_off.ring_mask);
+        cqes     = reinterpret_cast<io_uring_cqe*>(cq+p.cq_off.cqes);
+        sqes     = static_cast<io_uring_sqe*>(sqe_map);
+        return true;
+    }
+
+    // next free submission entry; the caller keeps inflight+queued below entries
+    io_uring_sqe& next()
+    {
+        unsigned tail = *sq_tail+queued;
+        unsigned index = tail & *sq_mask;
+        sq_array[index] = index;
+        ++queued;
+        io_uring_sqe &e = sqes[index];
+        memset(&e,0,sizeof(e));
+        return e;
+    }
+
+    // hand the prepared entries to the kernel and wait for min_complete
+    // completions, at most as many as are in flight once they are submitted
+    void enter(unsigned int min_complete)
+    {
+        __atomic_store_n(sq_tail,*sq_tail+queued,__ATOMIC_RELEASE);
+        const unsigned int submit = queued;
+        inflight += queued;
+        queued = 0;
+        min_complete = min(min_complete,inflight);
+        if(submit == 0 && min_complete == 0)
+            return;
+        while(syscall(__NR_io_uring_enter,fd,submit,min_complete,min_complete > 0 ? IORING_ENTER_GETEVENTS : 0,nullptr,0) < 0)
+        {
+            if(errno != EINTR)
+                throw runtime_error("io_uring_enter failed");
+        }
+    }
+};
+
+#else
+
+struct OutputWriter::Ring {
+};
+
+#endif
+
+OutputWriter::OutputWriter(OutputBackend b, size_t c, Logger &l)
+    : backend(b), chunk(round_up(c > 0 ? c : alignment,alignment)), logger(l)
+{
+#ifndef LBM_HAVE_IO_URING
+    if(backend == OutputBackend::IoUring)
+    {
+        logger.info("Warning: built without io_uring, writing the output with pwrite");
+        backend = OutputBackend::Posix;
+    }
+#endif
+}
+
+OutputWriter::~OutputWriter()
+{
+    try
+    {
+        flush();
+    }
+    catch(...)
+    {
+    }
+}
+
+size_t OutputWriter::footprint(size_t n) const
+{
+    return buffers()*(Arena::footprint<unsigned char>(round_up(n,alignment))+alignment);
+}
+
+void OutputWriter::allocate(Arena &arena, size_t n)
+{
+    bytes = n;
+    slots.resize(buffers());
+    for(Slot &s : slots)
+        s.data = arena.allocate<double>(round_up(n,alignment)/sizeof(double),alignment);
+}
+
+double* OutputWriter::buffer()
+{
+    Slot &s = slots[current];
+#ifdef LBM_HAVE_IO_URING
+    while(s.pending > 0)
+        reap(1);
+#endif
+    if(failed)
+    {
+        failed = false;
+        throw runtime_error("Error saving output file");
+    }
+    return s.data;
+}
+
+void OutputWriter::write(const char *path)
+{
+    if(backend == OutputBackend::IoUring && (ring || start_ring()))
+        write_ring(path);
+    else
+        write_posix(path,slots[current].data);
+}
+
+void OutputWriter::flush()
+{
+#ifdef LBM_HAVE_IO_URING
+    if(ring)
+        while(ring->inflight > 0)
+            reap(1);
+#endif
+    if(failed)
+    {
+        failed = false;
+        throw runtime_error("Error saving output file");
+    }
+}
+
+void OutputWriter::write_posix(const char *path, const double *data)
+{
+    int fd = open(path,O_WRONLY|O_CREAT|O_TRUNC,0644);
+    if(fd < 0)
+        throw runtime_error("Cannot open output file");
+
+    const char *p = reinterpret_cast<const char*>(data);
+    size_t done = 0;
+    bool ok = true;
+    while(done < bytes)
+    {
+        ssize_t w = pwrite(fd,p+done,bytes-done,done);
+        if(w < 0 && errno == EINTR)
+            continue;
+        if(w <= 0)
+        {
+            ok = false;
+            break;
+        }
+        done += w;
+    }
+    if(close(fd) != 0 || !ok)
+        throw runtime_error("Error saving output file");
+}
+
+#ifdef LBM_HAVE_IO_URING
+
+bool OutputWriter::start_ring()
+{
+    unique_ptr<Ring> r(new Ring);
+    if(!r->setup())
+    {
+        logger.info("Warning: io_uring is not available (%s), writing the output with pwrite",strerror(errno));
+        backend = OutputBackend::Posix;
+        return false;
+    }
+
+    // registered buffers spare the kernel mapping the pages on every write;
+    // without them (e.g. a low RLIMIT_MEMLOCK) plain writes are queued
+    vector<iovec> iov(slots.size());
+    for(size_t i = 0; i < slots.size(); ++i)
+        iov[i] = {slots[i].data,round_up(bytes,alignment)};
+    r->fixed = syscall(__NR_io_uring_register,r->fd,IORING_REGISTER_BUFFERS,iov.data(),unsigned(iov.size())) == 0;
+    logger.info("           output: io_uring, %zu KiB chunks%s",chunk/1024,r->fixed ? ", registered buffers" : "");
+    ring = move(r);
+    return true;
+}
+
+void OutputWriter::write_ring(const char *path)
+{
+    Slot &s = slots[current];
+    s.direct = true;
+    int fd = open(path,O_WRONLY|O_CREAT|O_TRUNC|O_DIRECT,0644);
+    if(fd < 0 && errno == EINVAL)
+    {
+        // the file system does not support O_DIRECT
+        s.direct = false;
+        fd = open(path,O_WRONLY|O_CREAT|O_TRUNC,0644);
+    }
+    if(fd < 0)
+        throw runtime_error("Cannot open output file");
+    s.fd = fd;
+
+    // direct writes cover whole pages, the file is truncated afterwards
+    const size_t length = s.direct ? round_up(bytes,alignment) : bytes;
+    const char *data = reinterpret_cast<const char*>(s.data);
+    // the file holds one more pending count while its chunks are queued, so
+    // the completions reaped for room in the ring cannot close it early
+    ++s.pending;
+    for(size_t offset = 0; offset < length; offset += chunk)
+    {
+        // a full ring is submitted and drained by a completion first, so
+        // neither the submission nor the completion queue overflows
+        while(ring->inflight+ring->queued >= Ring::entries)
+            reap(1);
+        io_uring_sqe &e = ring->next();
+        e.opcode = ring->fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        e.fd = fd;
+        e.addr = reinterpret_cast<uintptr_t>(data+offset);
+        e.len = min(chunk,length-offset);
+        e.off = offset;
+        e.buf_index = current;
+        e.user_data = (uint64_t(e.len) << 8) | current;
+        ++s.pending;
+    }
+    if(--s.pending == 0)
+        complete(s);
+    ring->enter(0);
+    current = (current+1)%slots.size();
+}
+
+// submit what is queued and process at least min_complete completions
+void OutputWriter::reap(unsigned int min_complete)
+{
+    ring->enter(min_complete);
+
+    unsigned head = *ring->cq_head;
+    const unsigned tail = __atomic_load_n(ring->cq_tail,__ATOMIC_ACQUIRE);
+    for(; head != tail; ++head)
+    {
+        const io_uring_cqe &c = ring->cqes[head & *ring->cq_mask];
+        Slot &s = slots[c.user_data & 0xff];
+        if(c.res < 0 || uint64_t(c.res) != c.user_data >> 8)
+            failed = true;
+        --ring->inflight;
+        if(--s.pending == 0)
+            complete(s);
+    }
+    __atomic_store_n(ring->cq_head,head,__ATOMIC_RELEASE);
+}
+
+// all chunks of a file are written
+void OutputWriter::complete(Slot &s)
+{
+    if(s.direct && ftruncate(s.fd,bytes) != 0)
+        failed = true;
+    if(close(s.fd) != 0)
+        failed = true;
+    s.fd = -1;
+}
+
+#else
+
+bool OutputWriter::start_ring()
+{
+    return false;
+}
+
+void OutputWriter::write_ring(const char*)
+{
+}
+
+void OutputWriter::reap(unsigned int)
+{
+}
+
+void OutputWriter::complete(Slot&)
+{
+}
+
+#endif
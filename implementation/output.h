@@ -0,0 +1,89 @@
+#ifndef __OUTPUT_H
+#define __OUTPUT_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+class Arena;
+class Logger;
+
+// how save_scalar writes its files
+enum class OutputBackend {
+    Posix,  // blocking pwrite from the output stage
+    IoUring // chunks in flight through io_uring, O_DIRECT where supported
+};
+
+// how save_scalar stores the fields
+enum class OutputEncoding {
+    Raw,    // one .bin file per field and step, through the OutputWriter
+    Delta,  // one .lbs series per field, key frames and deltas
+    Hdf5    // one HDF5 file, a group per step and a dataset per field
+};
+
+/**
+ * Writer of the output fields.
+ *
+ * The caller fills buffer() and hands it to write(). The POSIX backend
+ * writes the file with pwrite and returns when it is done. The io_uring
+ * backend splits the file into chunks, queues them all as writes from
+ * registered, page-aligned buffers and returns at once; with two buffers the
+ * next field is gathered while the previous one is still being written.
+ * Files are opened with O_DIRECT where the file system allows it and
+ * truncated to their size once complete. The ring is set up by the first
+ * write, on the thread that writes, and the writer falls back to pwrite when
+ * the kernel refuses it. Errors are thrown from the next call.
+ */
+class OutputWriter {
+public:
+    static const size_t alignment = 4096;   // O_DIRECT buffers, offsets and lengths
+
+    OutputWriter(OutputBackend backend, size_t chunk, Logger &logger);
+    ~OutputWriter();
+
+    OutputWriter(const OutputWriter&) = delete;
+    OutputWriter& operator=(const OutputWriter&) = delete;
+
+    // staging buffers of the backend and the arena bytes they need for files
+    // of the given size
+    unsigned int buffers() const { return backend == OutputBackend::IoUring ? 2 : 1; }
+    size_t footprint(size_t bytes) const;
+
+    // carve the staging buffers for files of the given size from the arena
+    void allocate(Arena &arena, size_t bytes);
+
+    // buffer for the next file; waits until its previous write completed
+    double* buffer();
+
+    // write the buffer returned by buffer() to path
+    void write(const char *path);
+
+    // wait for all writes
+    void flush();
+
+private:
+    struct Slot {
+        double *data = nullptr;
+        int fd = -1;
+        unsigned int pending = 0;   // chunks in flight
+        bool direct = false;        // opened with O_DIRECT, length padded
+    };
+    struct Ring;
+
+    bool start_ring();
+    void write_posix(const char *path, const double *data);
+    void write_ring(const char *path);
+    void reap(unsigned int min_complete);
+    void complete(Slot &s);
+
+    OutputBackend backend;
+    const size_t chunk;
+    Logger &logger;
+    size_t bytes = 0;
+    std::vector<Slot> slots;
+    unsigned int current = 0;
+    bool failed = false;
+    std::unique_ptr<Ring> ring;
+};
+
+#endif /* __OUTPUT_H */
@@ -0,0 +1,272 @@
+#include <cstring>
+#include "LBM.h"
+#include "pipeline.h"
+
+using namespace std;
+
+Pipeline::Executor::Executor() : ready(4), thread(&Executor::loop,this)
+{
+}
+
+Pipeline::Executor::~Executor()
+{
+    {
+        lock_guard<mutex> lock(m);
+        stop = true;
+    }
+    cv.notify_one();
+    thread.join();
+}
+
+void Pipeline::Executor::schedule(coroutine_handle<> h)
+{
+    {
+        lock_guard<mutex> lock(m);
+        ready[(head+count)%ready.size()] = h;
+        ++count;
+    }
+    cv.notify_one();
+}
+
+void Pipeline::Executor::loop()
+{
+    for(;;)
+    {
+        coroutine_handle<> h;
+        {
+            unique_lock<mutex> lock(m);
+            cv.wait(lock,[this]{ return count > 0 || stop; });
+            if(count == 0)
+                return;
+            h = ready[head];
+            head = (head+1)%ready.size();
+            --count;
+        }
+        h.resume();
+    }
+}
+
+Pipeline::Channel::Channel(Executor &e, size_t capacity) : exec(e), queue(capacity)
+{
+}
+
+void Pipeline::Channel::push(Snapshot *s)
+{
+    coroutine_handle<> h;
+    {
+        lock_guard<mutex> lock(m);
+        if(!waiter)
+        {
+            queue[(head+count)%queue.size()] = s;
+            ++count;
+            return;
+        }
+        // hand the snapshot directly to the suspended consumer
+        waiting->value = s;
+        h = waiter;
+        waiter = nullptr;
+        waiting = nullptr;
+    }
+    exec.schedule(h);
+}
+
+bool Pipeline::Channel::Awaiter::await_ready()
+{
+    lock_guard<mutex> lock(ch.m);
+    if(ch.count == 0)
+        return false;
+    value = ch.queue[ch.head];
+    ch.head = (ch.head+1)%ch.queue.size();
+    --ch.count;
+    return true;
+}
+
+bool Pipeline::Channel::Awaiter::await_suspend(coroutine_handle<> h)
+{
+    lock_guard<mutex> lock(ch.m);
+    if(ch.count > 0)
+    {
+        // something arrived since await_ready, continue without suspending
+        value = ch.queue[ch.head];
+        ch.head = (ch.head+1)%ch.queue.size();
+        --ch.count;
+        return false;
+    }
+    ch.waiter = h;
+    ch.waiting = this;
+    return true;
+}
+
+Pipeline::Pipeline(LBM &l, unsigned int depth)
+    : lbm(l), snapshots(depth > 0 ? depth : 1), stream(l),
+      to_analysis(exec,snapshots.size()+1), to_output(exec,snapshots.size()+1),
+      analysis(analysis_stage()), output(output_stage()), exec()
+{
+    free_list.reserve(snapshots.size());
+    for(auto &s : snapshots)
+    {
+        s.rho = lbm.arena.allocate<double>(lbm.NX*lbm.NY);
+        s.ux  = lbm.arena.allocate<double>(lbm.NX*lbm.NY);
+        s.uy  = lbm.arena.allocate<double>(lbm.NX*lbm.NY);
+        free_list.push_back(&s);
+    }
+
+    exec.schedule(analysis.handle);
+    exec.schedule(output.handle);
+}
+
+Pipeline::~Pipeline()
+{
+    try
+    {
+        finish();
+    }
+    catch(...)
+    {
+    }
+}
+
+void Pipeline::submit(unsigned int t, bool save, bool msg, mdspan<double, dextents<size_t, 2>> rho, mdspan<double, dextents<size_t, 2>> ux, mdspan<double, dextents<size_t, 2>> uy)
+{
+    Snapshot *s;
+    {
+        unique_lock<mutex> lock(m);
+        if(error)
+            rethrow_exception(error);
+        cv.wait(lock,[this]{ return !free_list.empty(); });
+        s = free_list.back();
+        free_list.pop_back();
+    }
+
+    s->t = t;
+    s->save = save;
+    s->msg = msg;
+
+    // the fields are contiguous, copy them in slabs
+    const size_t n = lbm.NX*lbm.NY;
+    lbm.pool.run([&](unsigned int tid)
+    {
+        size_t b = lbm.pool.begin(tid,n);
+        size_t e = lbm.pool.end(tid,n);
+        memcpy(s->rho+b,rho.data_handle()+b,(e-b)*sizeof(double));
+        memcpy(s->ux+b, ux.data_handle()+b, (e-b)*sizeof(double));
+        memcpy(s->uy+b, uy.data_handle()+b, (e-b)*sizeof(double));
+    });
+
+    to_analysis.push(s);
+}
+
+void Pipeline::finish()
+{
+    {
+        lock_guard<mutex> lock(m);
+        if(finished)
+            return;
+        finished = true;
+    }
+
+    // a null snapshot marks the end of the stream
+    to_analysis.push(nullptr);
+
+    unique_lock<mutex> lock(m);
+    cv.wait(lock,[this]{ return done; });
+    if(error)
+        rethrow_exception(error);
+}
+
+unsigned int Pipeline::in_flight()
+{
+    lock_guard<mutex> lock(m);
+    return snapshots.size()-free_list.size();
+}
+
+void Pipeline::fail()
+{
+    lock_guard<mutex> lock(m);
+    if(!error)
+        error = current_exception();
+}
+
+void Pipeline::release(Snapshot *s)
+{
+    {
+        lock_guard<mutex> lock(m);
+        free_list.push_back(s);
+    }
+    cv.notify_all();
+}
+
+Pipeline::Task Pipeline::analysis_stage()
+{
+    for(;;)
+    {
+        Snapshot *s = co_await to_analysis.pop();
+        if(s != nullptr && s->msg)
+        {
+            try
+            {
+                auto rho = mdspan(s->rho,lbm.NX,lbm.NY);
+                auto ux  = mdspan(s->ux, lbm.NX,lbm.NY);
+                auto uy  = mdspan(s->uy, lbm.NX,lbm.NY);
+                lbm.report_flow_properties(s->t,rho,ux,uy);
+            }
+            catch(...)
+            {
+                fail();
+            }
+        }
+        to_output.push(s);
+        if(s == nullptr)
+            co_return;
+    }
+}
+
+Pipeline::Task Pipeline::output_stage()
+{
+    for(;;)
+    {
+        Snapshot *s = co_await to_output.pop();
+        if(s == nullptr)
+        {
+            // the writer may still have files in flight, the stream a frame
+            try
+            {
+                lbm.output.flush();
+                lbm.hdf5.flush();
+                stream.finish();
+            }
+            catch(...)
+            {
+                fail();
+            }
+            {
+                lock_guard<mutex> lock(m);
+                done = true;
+            }
+            cv.notify_all();
+            co_return;
+        }
+        if(s->save)
+        {
+            try
+            {
+                auto rho = mdspan(s->rho,lbm.NX,lbm.NY);
+                auto ux  = mdspan(s->ux, lbm.NX,lbm.NY);
+                auto uy  = mdspan(s->uy, lbm.NX,lbm.NY);
+                if(stream.enabled())
+                    stream.send(s->t,rho,ux,uy);
+                if(!stream.enabled() || lbm.streamFiles)
+                {
+                    lbm.save_scalar("rho",rho,s->t);
+                    lbm.save_scalar("ux", ux, s->t);
+                    lbm.save_scalar("uy", uy, s->t);
+                }
+            }
+            catch(...)
+            {
+                fail();
+            }
+        }
+        release(s);
+    }
+}
@@ -0,0 +1,140 @@
+#ifndef __PIPELINE_H
+#define __PIPELINE_H
+
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <mdspan>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "stream.h"
+
+class LBM;
+
+/**
+ * Asynchronous analysis and output of the moments.
+ *
+ * The solver hands the moments of a time step to submit(), which copies them
+ * into one of a fixed number of snapshots and returns. The analysis stage
+ * (flow properties) and the output stage (save_scalar and the live stream)
+ * are coroutines that consume the snapshots on a background thread while the
+ * next time steps are computed. submit() blocks only when all snapshots are
+ * still in flight, which caps the memory used by the pipeline.
+ */
+class Pipeline {
+public:
+    struct Snapshot {
+        unsigned int t;
+        bool save;
+        bool msg;
+        double *rho, *ux, *uy; // carved from the LBM arena
+    };
+
+    Pipeline(LBM &lbm, unsigned int depth);
+    ~Pipeline();
+
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+    // queue the moments of step t; save writes them to disk, msg reports the flow properties
+    void submit(unsigned int t, bool save, bool msg, std::mdspan<double, std::dextents<size_t, 2>> rho, std::mdspan<double, std::dextents<size_t, 2>> ux, std::mdspan<double, std::dextents<size_t, 2>> uy);
+
+    // drain the pipeline; rethrows the first error raised by a stage
+    void finish();
+
+    // snapshots currently queued or being processed
+    unsigned int in_flight();
+
+private:
+    // lazily started coroutine, resumed only through the executor
+    struct Task {
+        struct promise_type {
+            Task get_return_object() { return Task{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+
+        explicit Task(std::coroutine_handle<promise_type> h) : handle(h) {}
+        Task(Task &&o) noexcept : handle(o.handle) { o.handle = nullptr; }
+        ~Task() { if(handle) handle.destroy(); }
+
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    // single background thread resuming the stage coroutines
+    class Executor {
+    public:
+        Executor();
+        ~Executor();
+        void schedule(std::coroutine_handle<> h);
+
+    private:
+        void loop();
+
+        std::mutex m;
+        std::condition_variable cv;
+        std::vector<std::coroutine_handle<>> ready; // fixed capacity, one slot per stage
+        size_t head = 0, count = 0;
+        bool stop = false;
+        std::thread thread;
+    };
+
+    // bounded queue of snapshots feeding a single consumer coroutine
+    class Channel {
+    public:
+        Channel(Executor &exec, size_t capacity);
+
+        // never blocks; capacity covers all snapshots plus the end marker
+        void push(Snapshot *s);
+
+        struct Awaiter {
+            Channel &ch;
+            Snapshot *value = nullptr;
+
+            bool await_ready();
+            bool await_suspend(std::coroutine_handle<> h);
+            Snapshot* await_resume() { return value; }
+        };
+        Awaiter pop() { return Awaiter{*this}; }
+
+    private:
+        Executor &exec;
+        std::mutex m;
+        std::vector<Snapshot*> queue;
+        size_t head = 0, count = 0;
+        std::coroutine_handle<> waiter;
+        Awaiter *waiting = nullptr;
+    };
+
+    Task analysis_stage();
+    Task output_stage();
+    void fail();
+    void release(Snapshot *s);
+
+    LBM &lbm;
+    std::vector<Snapshot> snapshots;
+
+    std::mutex m;
+    std::condition_variable cv;
+    std::vector<Snapshot*> free_list;
+    bool done = false;
+    bool finished = false;
+    std::exception_ptr error;
+
+    // live stream of the saved snapshots, fed by the output stage
+    SnapshotStream stream;
+
+    // the executor is declared last so that its thread is joined before
+    // the coroutine frames and channels it resumes are destroyed
+    Channel to_analysis;
+    Channel to_output;
+    Task analysis;
+    Task output;
+    Executor exec;
+};
+
+#endif /* __PIPELINE_H */
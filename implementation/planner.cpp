@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "logger.h"
+#include "planner.h"
+
+using namespace std;
+
+static const double bytesPerMiB = 1024.0*1024.0;
+
+size_t MemoryPlan::resident(bool out_of_core) const
+{
+    // populations, moments and mask live in mapped files when out of core
+    return out_of_core ? staging+snapshots+checkpoints : total();
+}
+
+size_t MemoryAvailable::usable() const
+{
+    if(system == 0)
+        return cgroup;
+    if(cgroup == 0)
+        return system;
+    return system < cgroup ? system : cgroup;
+}
+
+MemoryPlan plan_memory(const MemoryConfig &c)
+{
+    const size_t nodes = c.NX*c.NY;
+    const size_t scalar = sizeof(double)*nodes; // moments are always double
+
+    MemoryPlan p;
+    p.populations = c.value_bytes*nodes*(1+size_t(c.lattices)*(c.ndir-1));
+    p.moments     = 3*scalar;
+    p.staging     = scalar*c.staging;
+    p.snapshots   = 3*scalar*c.snapshots;
+    p.checkpoints = c.value_bytes*nodes*c.ndir*c.checkpoints;
+    p.geometry    = c.solids ? nodes : 0;
+    return p;
+}
+
+// value of "key: <n> kB" in a meminfo style file, in bytes; 0 if missing
+static size_t meminfo_value(const char *path, const char *key)
+{
+    FILE *f = fopen(path,"r");
+    if(f == nullptr)
+        return 0;
+
+    size_t value = 0;
+    char line[256];
+    while(fgets(line,sizeof(line),f) != nullptr)
+    {
+        const char *k = strstr(line,key);
+        if(k != nullptr && k[strlen(key)] == ':')
+        {
+            unsigned long long kb = 0;
+            if(sscanf(k+strlen(key)+1,"%llu",&kb) == 1)
+                value = size_t(kb)*1024;
+            break;
+        }
+    }
+    fclose(f);
+    return value;
+}
+
+// single number in a file, 0 if missing or "max"
+static size_t file_value(const char *path)
+{
+    FILE *f = fopen(path,"r");
+    if(f == nullptr)
+        return 0;
+    unsigned long long v = 0;
+    if(fscanf(f,"%llu",&v) != 1)
+        v = 0;
+    fclose(f);
+    return size_t(v);
+}
+
+MemoryAvailable available_memory()
+{
+    MemoryAvailable a;
+    a.system = meminfo_value("/proc/meminfo","MemAvailable");
+
+    // cgroup v2 limit of the job, if any
+    size_t limit = file_value("/sys/fs/cgroup/memory.max");
+    size_t used  = file_value("/sys/fs/cgroup/memory.current");
+    if(limit > 0)
+        a.cgroup = limit > used ? limit-used : 1;
+
+    // free memory per NUMA node, nodes are numbered consecutively
+    for(unsigned int node = 0; ; ++node)
+    {
+        char path[128];
+        snprintf(path,sizeof(path),"/sys/devices/system/node/node%u/meminfo",node);
+        FILE *f = fopen(path,"r");
+        if(f == nullptr)
+            break;
+        fclose(f);
+        a.numa_free.push_back(meminfo_value(path,"MemFree")+meminfo_value(path,"FilePages"));
+    }
+    return a;
+}
+
+bool admit(const MemoryConfig &c, Logger &logger)
+{
+    MemoryPlan p = plan_memory(c);
+    MemoryAvailable a = available_memory();
+    size_t need = p.resident(c.out_of_core);
+    size_t have = a.usable();
+
+    logger.info(" ----- memory plan -----");
+    logger.info("      populations: %.1f (MiB)%s",p.populations/bytesPerMiB,c.out_of_core ? " (mapped)" : "");
+    logger.info("          moments: %.1f (MiB)%s",p.moments/bytesPerMiB,c.out_of_core ? " (mapped)" : "");
+    logger.info("   output staging: %.1f (MiB)",p.staging/bytesPerMiB);
+    logger.info("        snapshots: %.1f (MiB)",p.snapshots/bytesPerMiB);
+    logger.info("      checkpoints: %.1f (MiB)",p.checkpoints/bytesPerMiB);
+    if(p.geometry > 0)
+        logger.info("       solid mask: %.1f (MiB)%s",p.geometry/bytesPerMiB,c.out_of_core ? " (mapped)" : "");
+    logger.info("   resident total: %.1f (MiB)",need/bytesPerMiB);
+    if(have > 0)
+        logger.info("        available: %.1f (MiB)",have/bytesPerMiB);
+    for(size_t node = 0; node < a.numa_free.size(); ++node)
+        logger.info("   node %zu available: %.1f (MiB)",node,a.numa_free[node]/bytesPerMiB);
+    logger.info("%s","");
+
+    // fields of this size span several nodes; warn if a node cannot
+    // take an even share
+    if(a.numa_free.size() > 1)
+    {
+        size_t share = need/a.numa_free.size();
+        for(size_t node = 0; node < a.numa_free.size(); ++node)
+        {
+            if(a.numa_free[node] < share)
+                logger.info("Warning: NUMA node %zu has %.1f MiB free, less than its share of %.1f MiB",node,a.numa_free[node]/bytesPerMiB,share/bytesPerMiB);
+        }
+    }
+
+    if(have == 0 || need <= have)
+        return true;
+
+    logger.error("the run needs %.1f MiB but only %.1f MiB are available.",need/bytesPerMiB,have/bytesPerMiB);
+    logger.info("Cheaper configurations:");
+
+    // only what this build can do: fewer snapshots or checkpoint buffers,
+    // and fields mapped from a backing directory
+    struct Alternative {
+        const char *description;
+        MemoryConfig config;
+        bool combined = false;
+    };
+    MemoryConfig one_snapshot = c;
+    one_snapshot.snapshots = 1;
+    MemoryConfig one_checkpoint = c;
+    one_checkpoint.checkpoints = min(c.checkpoints,1u);
+    MemoryConfig no_checkpoints = c;
+    no_checkpoints.checkpoints = 0;
+    MemoryConfig mapped = c;
+    mapped.out_of_core = true;
+    MemoryConfig least = no_checkpoints;
+    least.snapshots = 1;
+    least.out_of_core = true;
+    const Alternative alternatives[] = {
+        {"pipelineDepth = 1",                                   one_snapshot},
+        {"checkpointBuffers = 1",                               one_checkpoint},
+        {"checkpointInterval = 0",                              no_checkpoints},
+        {"a backing directory",                                 mapped},
+        {"all of the above",                                    least,  true},
+    };
+    // skip what the run does already, and the combination unless it saves
+    // more than every single change
+    size_t cheapest = plan_memory(c).resident(c.out_of_core);
+    const size_t current = cheapest;
+    for(const Alternative &alt : alternatives)
+    {
+        size_t bytes = plan_memory(alt.config).resident(alt.config.out_of_core);
+        if(bytes >= (alt.combined ? cheapest : current))
+            continue;
+        cheapest = min(cheapest,bytes);
+        logger.info("  %-52s %10.1f MiB%s",alt.description,bytes/bytesPerMiB,bytes <= have ? "  fits" : "");
+    }
+    logger.flush();
+    return false;
+}
@@ -0,0 +1,60 @@
+#ifndef __PLANNER_H
+#define __PLANNER_H
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Memory footprint of a run, computed before anything large is allocated.
+ *
+ * The plan counts the exact bytes of every large buffer for a given lattice,
+ * storage precision and streaming scheme. admit() compares it with the
+ * memory that is actually available (system, cgroup limit and NUMA nodes)
+ * so that a run that cannot fit fails at start-up instead of after hours in
+ * the queue.
+ */
+struct MemoryConfig {
+    size_t NX, NY;
+    unsigned int ndir;
+    size_t value_bytes;        // 8 for double, 4 for float storage
+    unsigned int lattices;     // population lattices: 2 for A-B, 1 for in-place streaming
+    unsigned int staging;      // output staging buffers of one field
+    unsigned int snapshots;    // pipeline snapshots of rho, ux, uy
+    unsigned int checkpoints;  // in-memory checkpoint buffers of all populations
+    bool solids;               // solid mask of one byte per node
+    bool out_of_core;          // populations, moments and mask mapped from files
+};
+
+struct MemoryPlan {
+    size_t populations = 0;    // f0 and the lattices of f1/f2
+    size_t moments = 0;        // rho, ux, uy
+    size_t staging = 0;        // output staging buffers
+    size_t snapshots = 0;      // pipeline snapshots
+    size_t checkpoints = 0;    // checkpoint buffers
+    size_t geometry = 0;       // solid mask
+
+    // bytes that must be resident in memory
+    size_t resident(bool out_of_core) const;
+    size_t total() const { return populations+moments+staging+snapshots+checkpoints+geometry; }
+};
+
+struct MemoryAvailable {
+    size_t system = 0;              // MemAvailable, 0 if unknown
+    size_t cgroup = 0;              // remaining cgroup allowance, 0 if unlimited
+    std::vector<size_t> numa_free;  // free memory per NUMA node
+
+    // the tighter of the system and cgroup limits, 0 if unknown
+    size_t usable() const;
+};
+
+MemoryPlan plan_memory(const MemoryConfig &c);
+MemoryAvailable available_memory();
+
+class Logger;
+
+// log the plan, check it against the available memory and, if it does not
+// fit, report the error and log cheaper configurations; returns false if
+// the run should be refused
+bool admit(const MemoryConfig &c, Logger &logger);
+
+#endif /* __PLANNER_H */
@@ -0,0 +1,165 @@
+#ifndef __REDUCTION_H
+#define __REDUCTION_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include "thread_pool.h"
+
+/**
+ * Partial sums of N quantities over one tile.
+ *
+ * With compensation enabled every sum carries a running error term
+ * (Neumaier's variant of Kahan summation), which makes the result nearly
+ * independent of the summation order and accurate to about the last bit.
+ */
+template<size_t N>
+struct PartialSums {
+    std::array<double, N> sum;
+    std::array<double, N> err;
+    bool compensated;
+
+    void reset(bool comp)
+    {
+        sum.fill(0.0);
+        err.fill(0.0);
+        compensated = comp;
+    }
+
+    void add(size_t k, double v)
+    {
+        if(!compensated)
+        {
+            sum[k] += v;
+            return;
+        }
+        double t = sum[k]+v;
+        if(std::fabs(sum[k]) >= std::fabs(v))
+            err[k] += (sum[k]-t)+v;
+        else
+            err[k] += (v-t)+sum[k];
+        sum[k] = t;
+    }
+
+    void merge(const PartialSums &o)
+    {
+        for(size_t k = 0; k < N; ++k)
+        {
+            add(k,o.sum[k]);
+            err[k] += o.err[k];
+        }
+    }
+
+    double value(size_t k) const { return sum[k]+err[k]; }
+};
+
+/**
+ * Extremes of the flow tracked by the kernel on watchdog steps.
+ *
+ * add() is called for every node with its density and squared speed and
+ * costs two min/max operations and a few compares. Nodes whose values are
+ * outside the limits or not finite are counted as violations; NaN fails
+ * both comparisons, so it is counted even though fmin/fmax skip it. The
+ * extremes are those of the finite nodes, the others are counted apart in
+ * nonfinite.
+ */
+struct alignas(64) FlowBounds {
+    double rho_min;
+    double usq_max;
+    unsigned long long violations;
+    unsigned long long nonfinite;
+
+    void reset()
+    {
+        rho_min = HUGE_VAL;
+        usq_max = 0.0;
+        violations = 0;
+        nonfinite = 0;
+    }
+
+    void add(double rho, double usq, double rho_limit, double usq_limit)
+    {
+        const bool finite = std::isfinite(rho) & std::isfinite(usq);
+        rho_min = std::fmin(rho_min,finite ? rho : HUGE_VAL);
+        usq_max = std::fmax(usq_max,finite ? usq : 0.0);
+        violations += !(rho >= rho_limit) | !(usq <= usq_limit);
+        nonfinite += !finite;
+    }
+
+    void merge(const FlowBounds &o)
+    {
+        rho_min = std::fmin(rho_min,o.rho_min);
+        usq_max = std::fmax(usq_max,o.usq_max);
+        violations += o.violations;
+        nonfinite += o.nonfinite;
+    }
+};
+
+/**
+ * Reproducible parallel reduction over a NX x NY domain.
+ *
+ * The domain is cut into tiles of a fixed size. Each tile is summed serially
+ * in a fixed order and the per-tile partial sums are combined by a pairwise
+ * tree whose shape depends only on the number of tiles. The thread count only
+ * decides which thread computes which tile, so the result is bitwise
+ * identical for any number of threads.
+ *
+ * The partial sums are allocated once at construction.
+ */
+template<size_t N>
+class TileReduction {
+public:
+    static constexpr size_t tile_nx = 64;
+    static constexpr size_t min_tile_ny = 16;
+    static constexpr size_t max_tiles = 65536;
+
+    // tiles grow in y on large grids to bound the number of partial sums;
+    // the tile shape still depends on the grid size only
+    TileReduction(size_t nx, size_t ny, bool comp)
+        : NX(nx), NY(ny), ntx((nx+tile_nx-1)/tile_nx), tile_ny(tile_height(ntx,ny)),
+          nty((ny+tile_ny-1)/tile_ny), compensated(comp), partials(ntx*nty)
+    {
+    }
+
+    // f(x0,x1,y0,y1,partial) adds the contribution of the nodes
+    // x0 <= x < x1, y0 <= y < y1 to partial; returns the reduced sums
+    template<class F>
+    const PartialSums<N>& run(ThreadPool &pool, F &&f)
+    {
+        const size_t ntiles = partials.size();
+        pool.run([&](unsigned int tid)
+        {
+            for(size_t i = pool.begin(tid,ntiles); i < pool.end(tid,ntiles); ++i)
+            {
+                size_t x0 = (i%ntx)*tile_nx;
+                size_t y0 = (i/ntx)*tile_ny;
+                partials[i].reset(compensated);
+                f(x0,std::min(x0+tile_nx,NX),y0,std::min(y0+tile_ny,NY),partials[i]);
+            }
+        });
+
+        // fixed-shape pairwise tree
+        for(size_t stride = 1; stride < ntiles; stride *= 2)
+        {
+            for(size_t i = 0; i+stride < ntiles; i += 2*stride)
+                partials[i].merge(partials[i+stride]);
+        }
+        return partials[0];
+    }
+
+private:
+    static size_t tile_height(size_t ntx, size_t ny)
+    {
+        size_t rows = std::max<size_t>(max_tiles/ntx,1);
+        return std::max(min_tile_ny,(ny+rows-1)/rows);
+    }
+
+    const size_t NX, NY;
+    const size_t ntx, tile_ny, nty;
+    const bool compensated;
+    std::vector<PartialSums<N>> partials;
+};
+
+#endif /* __REDUCTION_H */
@@ -0,0 +1,67 @@
+#include <cmath>
+#include "LBM.h"
+#include "schedule.h"
+
+using namespace std;
+
+OutputSchedule::OutputSchedule(const LBM &l, unsigned int first_step, mdspan<double, dextents<size_t, 2>> ux, mdspan<double, dextents<size_t, 2>> uy)
+    : lbm(l), adaptive(l.adaptiveOutput), probe_every(max(l.outputProbeInterval,1u)), last(first_step)
+{
+    double usq = 0.0;
+    for(size_t x = 0; x < lbm.NX; ++x)
+        for(size_t y = 0; y < lbm.NY; ++y)
+            usq = fmax(usq,ux[x,y]*ux[x,y]+uy[x,y]*uy[x,y]);
+    u_ref = u_peak = sqrt(usq);
+}
+
+unsigned int OutputSchedule::until(unsigned int n) const
+{
+    unsigned int s = lbm.NSTEPS-n;
+    if(!adaptive)
+        s = min(s,lbm.NSAVE-n%lbm.NSAVE);
+    else if(lbm.outputMaxInterval > 0)
+        s = min(s,last+lbm.outputMaxInterval-n);
+    if(probing())
+        s = min(s,probe_every-n%probe_every);
+    if(pending > n)
+        s = min(s,pending-n);
+    return s;
+}
+
+bool OutputSchedule::save(unsigned int t) const
+{
+    if(t == pending)
+        return true;
+    if(!adaptive)
+        return t%lbm.NSAVE == 0;
+    // the final state is always kept
+    return t == lbm.NSTEPS || (lbm.outputMaxInterval > 0 && t-last >= lbm.outputMaxInterval);
+}
+
+bool OutputSchedule::probe(unsigned int t) const
+{
+    // adaptive saves also take the bounds, the reference of the next change
+    return probing() && (t%probe_every == 0 || (adaptive && save(t)));
+}
+
+void OutputSchedule::update(unsigned int t, bool saved, const FlowBounds *b)
+{
+    const double u = b != nullptr ? sqrt(b->usq_max) : u_ref;
+    u_peak = fmax(u_peak,u);
+    if(saved)
+    {
+        last = t;
+        pending = 0;
+        u_ref = u;
+        ++count;
+        return;
+    }
+    if(b == nullptr || pending > t)
+        return;
+
+    bool request = adaptive && fabs(u-u_ref) > lbm.outputChange*u_peak;
+    for(const Trigger &trigger : triggers)
+        request = trigger(t,*b) || request;
+    if(request)
+        pending = max(t+1,last+lbm.outputMinInterval);
+}
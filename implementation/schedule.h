@@ -0,0 +1,63 @@
+#ifndef __SCHEDULE_H
+#define __SCHEDULE_H
+
+#include <cstddef>
+#include <functional>
+#include <mdspan>
+#include <vector>
+
+class LBM;
+struct FlowBounds;
+
+/**
+ * Output schedule of the step loop.
+ *
+ * Without adaptiveOutput the moments are saved every NSAVE steps. With it
+ * the schedule probes the flow every outputProbeInterval steps: the kernel
+ * tracks the smallest density and the largest speed of a probe step in the
+ * same pass as the watchdog bounds, so a probe costs no extra sweep. Once the
+ * largest speed moved by more than outputChange times its peak since the
+ * last save, the next step is saved; saves are at least outputMinInterval
+ * and at most outputMaxInterval steps apart, and the last step is saved.
+ * Late in a decaying run the flow barely changes and the saves thin out.
+ * Triggers added with add() see the bounds of every probe, in either mode,
+ * and request a save by returning true.
+ */
+class OutputSchedule {
+public:
+    // step and flow bounds of a probe; true saves the next step
+    using Trigger = std::function<bool(unsigned int, const FlowBounds&)>;
+
+    // starts from the moments of the first step, which is saved
+    OutputSchedule(const LBM &lbm, unsigned int first_step, std::mdspan<double, std::dextents<size_t, 2>> ux, std::mdspan<double, std::dextents<size_t, 2>> uy);
+
+    void add(Trigger trigger) { triggers.push_back(std::move(trigger)); }
+
+    // steps from n to the next step the loop must stop at to save or probe
+    unsigned int until(unsigned int n) const;
+
+    // whether step t is saved, and whether its bounds are needed
+    bool save(unsigned int t) const;
+    bool probe(unsigned int t) const;
+
+    // after step t; b holds its merged bounds if probe(t)
+    void update(unsigned int t, bool saved, const FlowBounds *b);
+
+    // saves after the first step
+    unsigned int saves() const { return count; }
+
+private:
+    bool probing() const { return adaptive || !triggers.empty(); }
+
+    const LBM &lbm;
+    const bool adaptive;
+    const unsigned int probe_every;
+    std::vector<Trigger> triggers;
+    unsigned int last;                  // step of the last save
+    unsigned int pending = 0;           // step of a requested save, 0 if none
+    unsigned int count = 0;
+    double u_ref;                       // largest speed at the last save
+    double u_peak;                      // largest speed seen
+};
+
+#endif /* __SCHEDULE_H */
@@ -0,0 +1,266 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "arena.h"
+#include "codec.h"
+#include "logger.h"
+#include "series.h"
+
+using namespace std;
+
+// difference of bit patterns with the sign in the lowest bit, so that small
+// differences of either sign have leading zero bytes
+static uint64_t zigzag(uint64_t d)
+{
+    return (d << 1) ^ uint64_t(int64_t(d) >> 63);
+}
+
+static uint64_t unzigzag(uint64_t z)
+{
+    return (z >> 1) ^ (0-(z & 1));
+}
+
+SeriesWriter::SeriesWriter(size_t nx, size_t ny, unsigned int k, Logger &l)
+    : NX(nx), NY(ny), keyInterval(max(k,1u)), logger(l)
+{
+}
+
+SeriesWriter::~SeriesWriter()
+{
+    for(Series &s : series)
+        if(s.fd >= 0)
+            close(s.fd);
+}
+
+size_t SeriesWriter::footprint(unsigned int fields) const
+{
+    return fields*Arena::footprint<double>(NX*NY);
+}
+
+void SeriesWriter::allocate(Arena &arena, unsigned int fields)
+{
+    series.resize(fields);
+    for(Series &s : series)
+        s.prev = arena.allocate<double>(NX*NY);
+    encoder.allocate();
+    packed.resize(BlockEncoder::bound());
+#ifndef LBM_HAVE_ZLIB
+    logger.info("Warning: built without zlib, the field series are not compressed");
+#endif
+}
+
+// create the series file of s, or continue it after resume()
+void SeriesWriter::open(Series &s)
+{
+    char path[128];
+    snprintf(path,sizeof(path),"%s.lbs",s.name);
+    int fd = ::open(path,O_RDWR|O_CREAT|(resuming ? 0 : O_TRUNC),0644);
+    if(fd < 0)
+        throw runtime_error("Cannot open series file");
+    s.fd = fd;
+
+    struct stat st;
+    if(fstat(fd,&st) != 0)
+        throw runtime_error("Cannot open series file");
+    const uint64_t size = st.st_size;
+    SeriesHeader h;
+    uint64_t end = sizeof(h);
+    if(size == 0)
+    {
+        memset(&h,0,sizeof(h));
+        memcpy(h.magic,"LBMSERIE",8);
+        h.version = SeriesHeader::current_version;
+        h.NX = NX;
+        h.NY = NY;
+        write_bytes(fd,&h,sizeof(h),"Error writing series file");
+        return;
+    }
+    if(pread(fd,&h,sizeof(h),0) != ssize_t(sizeof(h)) || memcmp(h.magic,"LBMSERIE",8) != 0 || h.version > SeriesHeader::current_version)
+        throw runtime_error("Not a series file of this version");
+    if(h.NX != NX || h.NY != NY)
+        throw runtime_error("Series file was written for another grid");
+
+    // continue after the last complete record
+    SeriesRecord r;
+    while(pread(fd,&r,sizeof(r),end) == ssize_t(sizeof(r)) && r.bytes > 0 && r.bytes <= size-end-sizeof(r))
+        end += sizeof(r)+r.bytes;
+    if(end < size)
+    {
+        if(ftruncate(fd,end) != 0)
+            throw runtime_error("Cannot repair series file");
+        logger.info("Warning: cut an incomplete record off %s",path);
+    }
+    if(lseek(fd,end,SEEK_SET) < 0)
+        throw runtime_error("Cannot open series file");
+}
+
+void SeriesWriter::append(const char *name, unsigned int t, const double *values)
+{
+    // names are few and fixed, find the series by a scan
+    Series *s = nullptr;
+    for(Series &c : series)
+    {
+        if(c.name == nullptr || strcmp(c.name,name) == 0)
+        {
+            s = &c;
+            break;
+        }
+    }
+    if(s == nullptr)
+        throw runtime_error("More series than buffers");
+    if(s->name == nullptr)
+    {
+        s->name = name;
+        open(*s);
+    }
+
+    const bool key = !s->have_prev || s->since_key+1 >= keyInterval;
+    SeriesRecord r;
+    r.step = t;
+    r.flags = key ? SeriesRecord::key : 0;
+#ifdef LBM_HAVE_ZLIB
+    r.flags |= SeriesRecord::deflated;
+#endif
+    r.bytes = 0;
+    const off_t start = lseek(s->fd,0,SEEK_CUR);
+    if(start < 0)
+        throw runtime_error("Error writing series file");
+    write_bytes(s->fd,&r,sizeof(r),"Error writing series file");
+
+    const size_t n = NX*NY;
+    for(size_t i = 0; i < n; i += block_values)
+    {
+        // the values, or their differences from the previous save, are
+        // shuffled into planes; the leading planes of a delta are mostly zero
+        const size_t m = min(block_values,n-i);
+        const size_t stored = encoder.encode(m,[&](size_t j)
+        {
+            return key ? bits(values[i+j]) : zigzag(bits(values[i+j])-bits(s->prev[i+j]));
+        },packed.data());
+        write_bytes(s->fd,packed.data(),stored,"Error writing series file");
+        r.bytes += stored;
+        memcpy(s->prev+i,values+i,m*sizeof(double));
+    }
+
+    // the size completes the record
+    if(pwrite(s->fd,&r,sizeof(r),start) != ssize_t(sizeof(r)))
+        throw runtime_error("Error writing series file");
+    s->have_prev = true;
+    s->since_key = key ? 0 : s->since_key+1;
+}
+
+SeriesReader::SeriesReader(const char *path)
+{
+    int fd = ::open(path,O_RDONLY);
+    if(fd < 0)
+        throw runtime_error("Cannot open series file");
+    struct stat st;
+    if(fstat(fd,&st) != 0 || size_t(st.st_size) < sizeof(SeriesHeader))
+    {
+        close(fd);
+        throw runtime_error("Series file is truncated");
+    }
+    file_bytes = st.st_size;
+    void *map = mmap(nullptr,file_bytes,PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd);
+    if(map == MAP_FAILED)
+        throw runtime_error("Cannot map series file");
+    file = static_cast<const unsigned char*>(map);
+
+    SeriesHeader h;
+    memcpy(&h,file,sizeof(h));
+    if(memcmp(h.magic,"LBMSERIE",8) != 0 || h.version > SeriesHeader::current_version)
+    {
+        munmap(map,file_bytes);
+        throw runtime_error("Not a series file of this version");
+    }
+    NX = h.NX;
+    NY = h.NY;
+
+    // index the complete records
+    uint64_t pos = sizeof(h);
+    SeriesRecord r;
+    while(file_bytes-pos >= sizeof(r))
+    {
+        memcpy(&r,file+pos,sizeof(r));
+        if(r.bytes == 0 || r.bytes > file_bytes-pos-sizeof(r))
+            break;
+        index.push_back({r.step,(r.flags & SeriesRecord::key) != 0,(r.flags & SeriesRecord::deflated) != 0,pos+sizeof(r),r.bytes});
+        pos += sizeof(r)+r.bytes;
+    }
+}
+
+SeriesReader::~SeriesReader()
+{
+    munmap(const_cast<unsigned char*>(file),file_bytes);
+}
+
+void SeriesReader::read(unsigned int t, double *out) const
+{
+    // the last record of t and the key frame its chain starts from
+    size_t i = index.size();
+    while(i > 0 && index[i-1].step != t)
+        --i;
+    if(i == 0)
+        throw runtime_error("Step is not in the series");
+    size_t k = --i;
+    while(!index[k].key)
+    {
+        if(k == 0)
+            throw runtime_error("Series has no key frame");
+        --k;
+    }
+
+    decode(index[k],out,false);
+    for(size_t j = k+1; j <= i; ++j)
+        decode(index[j],out,true);
+}
+
+// the values of a record, or with delta added to the previous values in out
+void SeriesReader::decode(const Entry &e, double *out, bool delta) const
+{
+    const size_t n = NX*NY;
+    const unsigned char *p = file+e.offset, *end = p+e.bytes;
+    vector<unsigned char> inflated;
+    size_t done = 0;
+    while(done < n)
+    {
+        uint64_t sizes[2];
+        if(size_t(end-p) < sizeof(sizes))
+            throw runtime_error("Series record is truncated");
+        memcpy(sizes,p,sizeof(sizes));
+        p += sizeof(sizes);
+        const size_t m = sizes[0]/sizeof(double);
+        if(m == 0 || sizes[0]%sizeof(double) != 0 || m > n-done || sizes[1] > size_t(end-p))
+            throw runtime_error("Series record is corrupt");
+
+        const unsigned char *planes = p;
+        if(e.deflated)
+        {
+#ifdef LBM_HAVE_ZLIB
+            if(!inflate_block(p,sizes[1],sizes[0],inflated))
+                throw runtime_error("Series record is corrupt");
+            planes = inflated.data();
+#else
+            throw runtime_error("Built without zlib, cannot read compressed series");
+#endif
+        }
+        else if(sizes[1] != sizes[0])
+            throw runtime_error("Series record is corrupt");
+
+        unshuffle_block(planes,m,sizeof(double),[&](size_t j, uint64_t v)
+        {
+            if(delta)
+                v = bits(out[done+j])+unzigzag(v);
+            memcpy(&out[done+j],&v,sizeof(v));
+        });
+        p += sizes[1];
+        done += m;
+    }
+}
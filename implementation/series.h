@@ -0,0 +1,129 @@
+#ifndef __SERIES_H
+#define __SERIES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "codec.h"
+
+class Arena;
+class Logger;
+
+// a series file starts with this header and continues with records: a
+// SeriesRecord and its payload, the values of one step in file order (x
+// fastest) as their bit patterns or, unless it is a key frame, as the
+// zig-zag coded differences of the bit patterns from those of the previous
+// record; split into blocks of two uint64_t sizes (raw, stored) and the
+// stored bytes, the bytes of the values shuffled into planes and, with the
+// deflated flag, compressed
+struct SeriesHeader {
+    static const uint32_t current_version = 1;
+
+    char magic[8];          // "LBMSERIE"
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t NX, NY;
+};
+
+struct SeriesRecord {
+    static const uint32_t key = 1;          // flag
+    static const uint32_t deflated = 2;     // flag
+
+    uint32_t step;
+    uint32_t flags;
+    uint64_t bytes;         // payload bytes; 0 while it is being written
+};
+
+/**
+ * Writer of the delta-encoded field series.
+ *
+ * Every field name gets a series <name>.lbs, appended to for each saved step.
+ * Consecutive saves of a smooth flow agree in sign, exponent and leading
+ * mantissa bits. The difference of the bit patterns, read as integers, from
+ * the previous save is small, and zig-zag coding keeps small negative
+ * differences small too; after the byte shuffle the leading planes are
+ * zero runs that deflate well. Every keyInterval-th record is a key frame, so
+ * a step is rebuilt from at most keyInterval records. The previous values
+ * of every field are kept in buffers carved from the LBM arena. A new run
+ * replaces the series of an earlier one; after resume(), for a restart, a
+ * series that exists is continued from a key frame, and a record left
+ * incomplete by a crash is cut off first.
+ */
+class SeriesWriter {
+public:
+    SeriesWriter(size_t NX, size_t NY, unsigned int keyInterval, Logger &logger);
+    ~SeriesWriter();
+
+    SeriesWriter(const SeriesWriter&) = delete;
+    SeriesWriter& operator=(const SeriesWriter&) = delete;
+
+    // arena bytes of the previous values of the given number of fields
+    size_t footprint(unsigned int fields) const;
+
+    // carve the buffers for that many fields from the arena
+    void allocate(Arena &arena, unsigned int fields);
+
+    // continue the existing series instead of replacing them; called before
+    // the first append
+    void resume() { resuming = true; }
+
+    // append the values of step t, in file order, to the series of name; the
+    // name must stay valid for the run
+    void append(const char *name, unsigned int t, const double *values);
+
+private:
+    struct Series {
+        const char *name = nullptr;
+        int fd = -1;
+        double *prev = nullptr;
+        unsigned int since_key = 0;     // records since the last key frame
+        bool have_prev = false;
+    };
+
+    void open(Series &s);
+
+    const size_t NX, NY;
+    const unsigned int keyInterval;
+    Logger &logger;
+    bool resuming = false;
+    std::vector<Series> series;
+    BlockEncoder encoder;
+    std::vector<unsigned char> packed;
+};
+
+/**
+ * Reader of a delta-encoded field series, used by lbm_series. read()
+ * rebuilds any step from the key frame before it and the deltas after it.
+ */
+class SeriesReader {
+public:
+    struct Entry {
+        unsigned int step;
+        bool key;
+        bool deflated;
+        uint64_t offset;    // of the payload
+        uint64_t bytes;
+    };
+
+    explicit SeriesReader(const char *path);
+    ~SeriesReader();
+
+    SeriesReader(const SeriesReader&) = delete;
+    SeriesReader& operator=(const SeriesReader&) = delete;
+
+    size_t NX, NY;
+    const std::vector<Entry>& entries() const { return index; }
+
+    // the values of step t in file order; the last record of t wins. Throws
+    // if t is not in the series.
+    void read(unsigned int t, double *out) const;
+
+private:
+    void decode(const Entry &e, double *out, bool delta) const;
+
+    const unsigned char *file = nullptr;
+    size_t file_bytes = 0;
+    std::vector<Entry> index;
+};
+
+#endif /* __SERIES_H */
@@ -0,0 +1,50 @@
+// Reader of the delta-encoded field series (outputEncoding Delta).
+//
+// usage: lbm_series series.lbs            list the records
+//        lbm_series series.lbs step out   rebuild a step into out, a file
+//                                         like the .bin save_scalar writes
+
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <vector>
+#include "series.h"
+
+using namespace std;
+
+int main(int argc, char *argv[])
+{
+    if(argc != 2 && argc != 4)
+    {
+        fprintf(stderr,"usage: %s series.lbs [step out]\n",argv[0]);
+        return -1;
+    }
+    try
+    {
+        SeriesReader series(argv[1]);
+        if(argc == 2)
+        {
+            const double raw = series.NX*series.NY*sizeof(double);
+            printf("# %zux%zu, %zu records\n",series.NX,series.NY,series.entries().size());
+            printf("step,kind,bytes,ratio\n");
+            for(const SeriesReader::Entry &e : series.entries())
+                printf("%u,%s,%llu,%.2f\n",e.step,e.key ? "key" : "delta",(unsigned long long)e.bytes,raw/e.bytes);
+            return 0;
+        }
+
+        vector<double> values(series.NX*series.NY);
+        series.read(strtoul(argv[2],nullptr,10),values.data());
+        FILE *out = fopen(argv[3],"wb");
+        if(out == nullptr || fwrite(values.data(),sizeof(double),values.size(),out) != values.size() || fclose(out) != 0)
+        {
+            fprintf(stderr,"Error: cannot write %s\n",argv[3]);
+            return -1;
+        }
+    }
+    catch(const exception &e)
+    {
+        fprintf(stderr,"Error: %s\n",e.what());
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,46 @@
+#include <cstdio>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "storage.h"
+
+using namespace std;
+
+FieldBuffer::FieldBuffer(size_t n, const char *dir) : count(n)
+{
+    if(dir == nullptr)
+    {
+        ptr = new double[count];
+        return;
+    }
+
+    char path[4096];
+    snprintf(path,sizeof(path),"%s/lbm_field_XXXXXX",dir);
+    int fd = mkstemp(path);
+    if(fd < 0)
+        throw runtime_error("Cannot create backing file");
+    unlink(path);
+
+    // extend without writing, the file stays sparse until pages are touched
+    if(ftruncate(fd,bytes()) != 0)
+    {
+        close(fd);
+        throw runtime_error("Cannot size backing file");
+    }
+    void *p = mmap(nullptr,bytes(),PROT_READ|PROT_WRITE,MAP_SHARED|MAP_NORESERVE,fd,0);
+    close(fd);
+    if(p == MAP_FAILED)
+        throw runtime_error("Cannot map backing file");
+
+    ptr = static_cast<double*>(p);
+    mapped = true;
+}
+
+FieldBuffer::~FieldBuffer()
+{
+    if(mapped)
+        munmap(ptr,bytes());
+    else
+        delete[] ptr;
+}
@@ -0,0 +1,32 @@
+#ifndef __STORAGE_H
+#define __STORAGE_H
+
+#include <cstddef>
+
+/**
+ * Memory for a field of count doubles.
+ *
+ * Without a directory the field lives on the heap. With a directory it is
+ * backed by a sparse, already unlinked file in that directory which is mapped
+ * into memory; pages are only materialised when touched and the kernel can
+ * write them back, so grids larger than main memory can run out of core.
+ */
+class FieldBuffer {
+public:
+    explicit FieldBuffer(size_t count, const char *dir = nullptr);
+    ~FieldBuffer();
+
+    FieldBuffer(const FieldBuffer&) = delete;
+    FieldBuffer& operator=(const FieldBuffer&) = delete;
+
+    double* get() const { return ptr; }
+    size_t size() const { return count; }
+    size_t bytes() const { return count*sizeof(double); }
+
+private:
+    double *ptr = nullptr;
+    const size_t count;
+    bool mapped = false;
+};
+
+#endif /* __STORAGE_H */
@@ -0,0 +1,202 @@
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "LBM.h"
+#include "codec.h"
+#include "stream.h"
+
+using namespace std;
+
+size_t SnapshotStream::footprint(size_t NX, size_t NY)
+{
+    return Arena::footprint<unsigned char>(sizeof(StreamFrameHeader)+3*NX*NY*sizeof(double));
+}
+
+SnapshotStream::SnapshotStream(LBM &l) : lbm(l)
+{
+    if(lbm.streamPath == nullptr)
+        return;
+
+    const size_t n = 3*lbm.NX*lbm.NY;
+    frame = lbm.arena.allocate<unsigned char>(sizeof(StreamFrameHeader)+n*sizeof(double));
+#ifdef LBM_HAVE_ZLIB
+    if(lbm.streamCompress)
+    {
+        const size_t blocks = (n+block_values-1)/block_values;
+        encoder.allocate();
+        packed.resize(sizeof(StreamFrameHeader)+blocks*BlockEncoder::bound());
+    }
+#else
+    if(lbm.streamCompress)
+        lbm.logger.info("Warning: built without zlib, stream frames are not compressed");
+#endif
+    // a FIFO whose reader went away raises SIGPIPE on write
+    signal(SIGPIPE,SIG_IGN);
+}
+
+SnapshotStream::~SnapshotStream()
+{
+    if(fd >= 0)
+        close(fd);
+}
+
+// connect to the consumer at streamPath; false if there is none
+bool SnapshotStream::attach()
+{
+    struct stat st;
+    if(stat(lbm.streamPath,&st) == 0 && S_ISFIFO(st.st_mode))
+    {
+        // fails with ENXIO while no reader has the FIFO open
+        fd = open(lbm.streamPath,O_WRONLY|O_NONBLOCK);
+        socket = false;
+    }
+    else
+    {
+        sockaddr_un addr;
+        memset(&addr,0,sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if(strlen(lbm.streamPath) >= sizeof(addr.sun_path))
+            throw runtime_error("Stream socket path is too long");
+        strcpy(addr.sun_path,lbm.streamPath);
+        fd = ::socket(AF_UNIX,SOCK_STREAM|SOCK_NONBLOCK,0);
+        if(fd >= 0 && connect(fd,reinterpret_cast<sockaddr*>(&addr),sizeof(addr)) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+        socket = true;
+    }
+    if(fd < 0)
+    {
+        if(!warned)
+            lbm.logger.info("Warning: no consumer at %s, skipping frames until one attaches",lbm.streamPath);
+        warned = true;
+        return false;
+    }
+
+    // room for a whole frame in the kernel, where the limits allow it
+    int room = int(min<size_t>(sizeof(StreamFrameHeader)+3*lbm.NX*lbm.NY*sizeof(double),1 << 30));
+    if(socket)
+        setsockopt(fd,SOL_SOCKET,SO_SNDBUF,&room,sizeof(room));
+    else
+        fcntl(fd,F_SETPIPE_SZ,room);
+    lbm.logger.info("Streaming frames to %s",lbm.streamPath);
+    warned = false;
+    return true;
+}
+
+void SnapshotStream::detach(const char *reason)
+{
+    lbm.logger.info("Warning: stream consumer at %s %s",lbm.streamPath,reason);
+    close(fd);
+    fd = -1;
+    pending_bytes = 0;
+}
+
+// write the pending frame; without wait only as far as the consumer takes
+// it at once. Returns true once nothing is pending.
+bool SnapshotStream::drain(bool wait)
+{
+    while(pending_bytes > 0)
+    {
+        ssize_t w = socket ? ::send(fd,pending,pending_bytes,MSG_NOSIGNAL) : ::write(fd,pending,pending_bytes);
+        if(w > 0)
+        {
+            pending += w;
+            pending_bytes -= w;
+            continue;
+        }
+        if(w < 0 && errno == EINTR)
+            continue;
+        if(w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            if(!wait)
+                return false;
+            pollfd p = {fd,POLLOUT,0};
+            if(poll(&p,1,-1) < 0 && errno != EINTR)
+                throw runtime_error("Error waiting for the stream consumer");
+            continue;
+        }
+        if(w < 0 && (errno == EPIPE || errno == ECONNRESET))
+        {
+            detach("went away");
+            return true;
+        }
+        throw runtime_error("Error writing stream frame");
+    }
+    return true;
+}
+
+void SnapshotStream::send(unsigned int t, mdspan<double, dextents<size_t, 2>> rho, mdspan<double, dextents<size_t, 2>> ux, mdspan<double, dextents<size_t, 2>> uy)
+{
+    // the consumer has not finished the last frame yet
+    if(fd >= 0 && !drain(lbm.streamPolicy == StreamPolicy::Block))
+    {
+        ++dropped;
+        return;
+    }
+    if(fd < 0 && !attach())
+    {
+        ++dropped;
+        return;
+    }
+
+    // gather in file order (x fastest), as save_scalar does
+    const size_t n = lbm.NX*lbm.NY;
+    double *values = reinterpret_cast<double*>(frame+sizeof(StreamFrameHeader));
+    mdspan<double, dextents<size_t, 2>> fields[3] = {rho,ux,uy};
+    for(size_t i = 0; i < 3; ++i)
+    {
+        double *dst = values+i*n;
+        for(size_t y = 0; y < lbm.NY; ++y)
+            for(size_t x = 0; x < lbm.NX; ++x)
+                dst[lbm.scalar_index(x,y)] = fields[i][x,y];
+    }
+
+    StreamFrameHeader h;
+    memset(&h,0,sizeof(h));
+    memcpy(h.magic,"LBMFRAME",8);
+    h.version = StreamFrameHeader::current_version;
+    h.NX = lbm.NX;
+    h.NY = lbm.NY;
+    h.step = t;
+    h.fields = 3;
+    h.payload_bytes = 3*n*sizeof(double);
+    h.dropped = dropped;
+
+    unsigned char *buf = frame;
+#ifdef LBM_HAVE_ZLIB
+    if(lbm.streamCompress)
+    {
+        // byte-shuffled blocks, as in the compressed checkpoints
+        unsigned char *out = packed.data()+sizeof(StreamFrameHeader);
+        for(size_t i = 0; i < 3*n; i += block_values)
+        {
+            const size_t m = min(block_values,3*n-i);
+            out += encoder.encode(m,[&](size_t j) { return bits(values[i+j]); },out);
+        }
+        h.flags = StreamFrameHeader::compressed;
+        h.payload_bytes = out-packed.data()-sizeof(StreamFrameHeader);
+        buf = packed.data();
+    }
+#endif
+    memcpy(buf,&h,sizeof(h));
+    pending = buf;
+    pending_bytes = sizeof(h)+h.payload_bytes;
+    dropped = 0;
+
+    drain(lbm.streamPolicy == StreamPolicy::Block);
+}
+
+void SnapshotStream::finish()
+{
+    if(fd >= 0)
+        drain(true);
+}
@@ -0,0 +1,85 @@
+#ifndef __STREAM_H
+#define __STREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mdspan>
+#include <vector>
+#include "codec.h"
+
+class LBM;
+
+// what the stream does with a frame while the consumer still reads the last one
+enum class StreamPolicy {
+    Block,  // wait for the consumer
+    Drop    // skip the frame
+};
+
+// header of a stream frame, followed by payload_bytes: rho, ux and uy as
+// NX*NY doubles each in file order (x fastest), or with the compressed flag
+// as blocks of two uint64_t sizes (raw, packed) and the packed bytes, the
+// bytes of the values shuffled into planes and deflated
+struct StreamFrameHeader {
+    static const uint32_t current_version = 1;
+    static const uint32_t compressed = 1;   // flag
+
+    char magic[8];          // "LBMFRAME"
+    uint32_t version;
+    uint32_t flags;
+    uint64_t NX, NY;
+    uint32_t step;
+    uint32_t fields;        // 3: rho, ux, uy
+    uint64_t payload_bytes;
+    uint64_t dropped;       // frames skipped since the previous one
+};
+
+/**
+ * Live streaming of the saved moments to a consumer on the same node.
+ *
+ * The consumer listens on a Unix domain socket or reads a FIFO at
+ * streamPath; the stream attaches to it on the first frame and again after
+ * it went away, and skips frames while no consumer is attached. Each frame
+ * is gathered into a buffer carved from the LBM arena and written with
+ * non-blocking system calls, so the output stage never waits on a consumer
+ * that is not reading. A frame that is only partly taken stays pending;
+ * under the Drop policy the next frames are skipped, and counted in the
+ * header, until it is through, under the Block policy the output stage
+ * waits. Frames are never cut, the consumer sees whole frames only.
+ */
+class SnapshotStream {
+public:
+    explicit SnapshotStream(LBM &lbm);
+    ~SnapshotStream();
+
+    SnapshotStream(const SnapshotStream&) = delete;
+    SnapshotStream& operator=(const SnapshotStream&) = delete;
+
+    bool enabled() const { return frame != nullptr; }
+
+    // arena bytes of the frame buffer for an NX x NY grid
+    static size_t footprint(size_t NX, size_t NY);
+
+    // stream the moments of step t; called from the output stage only
+    void send(unsigned int t, std::mdspan<double, std::dextents<size_t, 2>> rho, std::mdspan<double, std::dextents<size_t, 2>> ux, std::mdspan<double, std::dextents<size_t, 2>> uy);
+
+    // hand the pending frame to the consumer
+    void finish();
+
+private:
+    bool attach();
+    void detach(const char *reason);
+    bool drain(bool wait);
+
+    LBM &lbm;
+    unsigned char *frame = nullptr;     // header and raw payload
+    BlockEncoder encoder;
+    std::vector<unsigned char> packed;
+    int fd = -1;
+    bool socket = false;
+    bool warned = false;                // no consumer attached, logged once
+    const unsigned char *pending = nullptr;
+    size_t pending_bytes = 0;
+    uint64_t dropped = 0;
+};
+
+#endif /* __STREAM_H */
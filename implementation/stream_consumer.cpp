@@ -0,0 +1,193 @@
+// Reference consumer of the live snapshot stream.
+//
+// usage: lbm_stream_consumer [--fifo] [--delay ms] path
+// listens on a Unix domain socket at path (or, with --fifo, creates and reads
+// a FIFO there), accepts one solver and prints a line per frame: the step,
+// the frames the solver skipped before it, the mean density and the largest
+// speed. --delay sleeps after every frame to mimic a slow analysis and
+// exercise the backpressure policy of the solver.
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "codec.h"
+#include "stream.h"
+
+using namespace std;
+
+// read exactly bytes; false at the end of the stream
+static bool read_bytes(int fd, void *data, size_t bytes)
+{
+    char *p = static_cast<char*>(data);
+    while(bytes > 0)
+    {
+        ssize_t r = read(fd,p,bytes);
+        if(r < 0 && errno == EINTR)
+            continue;
+        if(r <= 0)
+            return false;
+        p += r;
+        bytes -= r;
+    }
+    return true;
+}
+
+// the values of a compressed payload; false if it is corrupt
+static bool unpack(const vector<unsigned char> &payload, vector<double> &values)
+{
+#ifdef LBM_HAVE_ZLIB
+    vector<unsigned char> planes;
+    size_t pos = 0, done = 0;
+    while(pos < payload.size())
+    {
+        uint64_t sizes[2];
+        if(payload.size()-pos < sizeof(sizes))
+            return false;
+        memcpy(sizes,payload.data()+pos,sizeof(sizes));
+        pos += sizeof(sizes);
+        const size_t n = sizes[0]/sizeof(double);
+        if(sizes[1] > payload.size()-pos || n == 0 || n > values.size()-done)
+            return false;
+        if(!inflate_block(payload.data()+pos,sizes[1],sizes[0],planes))
+            return false;
+        unshuffle_block(planes.data(),n,sizeof(double),[&](size_t j, uint64_t v)
+        {
+            memcpy(&values[done+j],&v,sizeof(v));
+        });
+        pos += sizes[1];
+        done += n;
+    }
+    return done == values.size();
+#else
+    (void)payload;
+    (void)values;
+    fprintf(stderr,"Error: built without zlib, cannot read compressed frames\n");
+    return false;
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+    bool fifo = false;
+    unsigned int delay = 0;
+    int arg = 1;
+    for(; arg < argc && strncmp(argv[arg],"--",2) == 0; ++arg)
+    {
+        if(strcmp(argv[arg],"--fifo") == 0)
+            fifo = true;
+        else if(strcmp(argv[arg],"--delay") == 0 && arg+1 < argc)
+            delay = strtoul(argv[++arg],nullptr,10);
+        else
+        {
+            fprintf(stderr,"Error: unknown option %s\n",argv[arg]);
+            return -1;
+        }
+    }
+    if(arg+1 != argc)
+    {
+        fprintf(stderr,"usage: %s [--fifo] [--delay ms] path\n",argv[0]);
+        return -1;
+    }
+    const char *path = argv[arg];
+
+    int fd;
+    if(fifo)
+    {
+        if(mkfifo(path,0600) != 0 && errno != EEXIST)
+        {
+            fprintf(stderr,"Error: cannot create FIFO %s: %s\n",path,strerror(errno));
+            return -1;
+        }
+        // blocks until the solver opens the other end
+        fd = open(path,O_RDONLY);
+    }
+    else
+    {
+        sockaddr_un addr;
+        memset(&addr,0,sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if(strlen(path) >= sizeof(addr.sun_path))
+        {
+            fprintf(stderr,"Error: socket path %s is too long\n",path);
+            return -1;
+        }
+        strcpy(addr.sun_path,path);
+        unlink(path);
+        int listener = socket(AF_UNIX,SOCK_STREAM,0);
+        if(listener < 0 || bind(listener,reinterpret_cast<sockaddr*>(&addr),sizeof(addr)) != 0 || listen(listener,1) != 0)
+        {
+            fprintf(stderr,"Error: cannot listen on %s: %s\n",path,strerror(errno));
+            return -1;
+        }
+        fd = accept(listener,nullptr,nullptr);
+        close(listener);
+        unlink(path);
+    }
+    if(fd < 0)
+    {
+        fprintf(stderr,"Error: cannot open %s: %s\n",path,strerror(errno));
+        return -1;
+    }
+
+    printf("step,dropped,mean_rho,max_u\n");
+    fflush(stdout);
+    StreamFrameHeader h;
+    vector<unsigned char> payload;
+    vector<double> values;
+    unsigned int frames = 0;
+    while(read_bytes(fd,&h,sizeof(h)))
+    {
+        if(memcmp(h.magic,"LBMFRAME",8) != 0 || h.version != StreamFrameHeader::current_version || h.fields != 3)
+        {
+            fprintf(stderr,"Error: not a snapshot stream\n");
+            return -1;
+        }
+        payload.resize(h.payload_bytes);
+        if(!read_bytes(fd,payload.data(),payload.size()))
+        {
+            fprintf(stderr,"Error: stream ends within frame %u\n",h.step);
+            return -1;
+        }
+        const size_t n = h.NX*h.NY;
+        values.resize(3*n);
+        if(h.flags & StreamFrameHeader::compressed)
+        {
+            if(!unpack(payload,values))
+            {
+                fprintf(stderr,"Error: corrupt frame %u\n",h.step);
+                return -1;
+            }
+        }
+        else if(payload.size() == values.size()*sizeof(double))
+            memcpy(values.data(),payload.data(),payload.size());
+        else
+        {
+            fprintf(stderr,"Error: frame %u has %zu bytes\n",h.step,payload.size());
+            return -1;
+        }
+
+        const double *rho = values.data(), *ux = rho+n, *uy = ux+n;
+        double sum = 0.0, umax = 0.0;
+        for(size_t i = 0; i < n; ++i)
+        {
+            sum += rho[i];
+            umax = fmax(umax,sqrt(ux[i]*ux[i]+uy[i]*uy[i]));
+        }
+        printf("%u,%llu,%.10g,%.10g\n",h.step,(unsigned long long)h.dropped,sum/n,umax);
+        fflush(stdout);
+        ++frames;
+        if(delay > 0)
+            usleep(delay*1000);
+    }
+    close(fd);
+    fprintf(stderr,"%u frames\n",frames);
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include <new>
+#include "thread_pool.h"
+
+using namespace std;
+
+SpinBarrier::SpinBarrier(unsigned int n) : count(n), remaining(n), global_sense(false)
+{
+}
+
+void SpinBarrier::wait(bool &sense)
+{
+    sense = !sense;
+    if(remaining.fetch_sub(1,memory_order_acq_rel) == 1)
+    {
+        // last thread to arrive resets the counter and releases the others
+        remaining.store(count,memory_order_relaxed);
+        global_sense.store(sense,memory_order_release);
+        // a system call only if a waiter sleeps
+        global_sense.notify_all();
+        return;
+    }
+
+    unsigned int spins = 0;
+    while(global_sense.load(memory_order_acquire) != sense)
+    {
+        if(spins < spin_limit+yield_limit)
+        {
+            if(spins++ >= spin_limit)
+                this_thread::yield();
+        }
+        else
+            global_sense.wait(!sense,memory_order_acquire);
+    }
+}
+
+void SpinBarrier::reset()
+{
+    remaining.store(count,memory_order_relaxed);
+    global_sense.store(false,memory_order_release);
+}
+
+ThreadPool::ThreadPool(unsigned int n)
+    : nthreads(n > 0 ? n : 1), barrier(nthreads), owner(this_thread::get_id())
+{
+    threads.reserve(nthreads-1);
+    for(unsigned int tid = 1; tid < nthreads; ++tid)
+        threads.emplace_back(&ThreadPool::worker,this,tid);
+}
+
+ThreadPool::~ThreadPool()
+{
+    if(threads.empty())
+        return;
+
+    stop = true;
+    barrier.wait(master_sense);
+    for(auto &t : threads)
+        t.join();
+}
+
+void ThreadPool::after_fork()
+{
+    barrier.reset();
+    stop = false;
+    busy = false;
+    master_sense = false;
+    owner = this_thread::get_id();
+
+    // the handles name threads of the parent whose descriptors the child
+    // has already recycled; joining or detaching them could hit one of the
+    // new threads, so the new threads are constructed over them
+    for(unsigned int tid = 1; tid < nthreads; ++tid)
+        new (&threads[tid-1]) thread(&ThreadPool::worker,this,tid);
+}
+
+void ThreadPool::dispatch(void (*fn)(void*, unsigned int), void *ctx)
+{
+    if(threads.empty() || this_thread::get_id() != owner || busy)
+    {
+        for(unsigned int tid = 0; tid < nthreads; ++tid)
+            fn(ctx,tid);
+        return;
+    }
+
+    busy = true;
+    job_fn = fn;
+    job_ctx = ctx;
+
+    barrier.wait(master_sense); // release the workers
+    fn(ctx,0);
+    barrier.wait(master_sense); // wait for all of them to finish
+
+    busy = false;
+}
+
+void ThreadPool::worker(unsigned int tid)
+{
+    bool sense = false;
+    for(;;)
+    {
+        barrier.wait(sense);
+        if(stop)
+            return;
+        job_fn(job_ctx,tid);
+        barrier.wait(sense);
+    }
+}
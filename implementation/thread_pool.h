@@ -0,0 +1,91 @@
+#ifndef __THREAD_POOL_H
+#define __THREAD_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Sense-reversing barrier for a fixed number of threads.
+ *
+ * Every thread keeps its own sense flag and passes it to wait(). Waiters spin
+ * for a short while, which keeps the latency low when all threads arrive at
+ * nearly the same time, then fall back to yielding the core and finally
+ * block in the kernel, so workers that stay idle, e.g. while the owner waits
+ * for ensemble members or output, take no CPU time.
+ */
+class SpinBarrier {
+public:
+    explicit SpinBarrier(unsigned int n);
+    void wait(bool &sense);
+
+    // back to the initial state; no thread may be waiting
+    void reset();
+
+private:
+    static const unsigned int spin_limit = 4096;
+    static const unsigned int yield_limit = 1024;
+
+    const unsigned int count;
+    alignas(64) std::atomic<unsigned int> remaining;
+    alignas(64) std::atomic<bool> global_sense;
+};
+
+/**
+ * Persistent pool of worker threads.
+ *
+ * The threads are created once and stay alive for the whole run, so a time
+ * step costs two barrier crossings instead of a thread fork/join. run() hands
+ * a job to all threads, the calling thread takes part as thread 0, and it
+ * returns when every thread has finished the job.
+ *
+ * Only the thread that created the pool dispatches to the workers. Calls from
+ * any other thread, or nested calls from inside a job, execute the job for
+ * all thread ids in turn on the calling thread.
+ */
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned int nthreads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned int size() const { return nthreads; }
+
+    // in a child created by fork() while the pool was idle: the workers only
+    // exist in the parent, start new ones
+    void after_fork();
+
+    // run job(tid) for tid = 0..size()-1
+    template<class F>
+    void run(F &&job)
+    {
+        using J = std::remove_reference_t<F>;
+        dispatch([](void *ctx, unsigned int tid) { (*static_cast<J*>(ctx))(tid); }, &job);
+    }
+
+    // slab [begin,end) of the range [0,n) that belongs to thread tid
+    size_t begin(unsigned int tid, size_t n) const { return n*tid/nthreads; }
+    size_t end(unsigned int tid, size_t n) const { return n*(tid+1)/nthreads; }
+
+private:
+    void dispatch(void (*fn)(void*, unsigned int), void *ctx);
+    void worker(unsigned int tid);
+
+    const unsigned int nthreads;
+    SpinBarrier barrier;
+    std::vector<std::thread> threads;
+    std::thread::id owner;
+
+    // current job; published to the workers by the barrier
+    void (*job_fn)(void*, unsigned int) = nullptr;
+    void *job_ctx = nullptr;
+    bool stop = false;
+    bool busy = false;
+    bool master_sense = false;
+};
+
+#endif /* __THREAD_POOL_H */
@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include "thread_pool.h"
+#include "voxel.h"
+
+using namespace std;
+
+// lattice velocities of the directions 0..8
+static const int cx[9] = {0,1,0,-1,0,1,-1,-1,1};
+static const int cy[9] = {0,0,1,0,-1,1,1,-1,-1};
+
+// the whole file, followed by a NUL for the ASCII parser
+static vector<char> read_file(const char *path)
+{
+    FILE *f = fopen(path,"rb");
+    if(f == nullptr)
+        throw runtime_error(string("Cannot open STL file: ")+path);
+    vector<char> data;
+    char buffer[1 << 16];
+    size_t n;
+    while((n = fread(buffer,1,sizeof(buffer),f)) > 0)
+        data.insert(data.end(),buffer,buffer+n);
+    const bool failed = ferror(f) != 0;
+    fclose(f);
+    if(failed)
+        throw runtime_error(string("Cannot read STL file: ")+path);
+    return data;
+}
+
+// the triangles of a binary or ASCII STL file, three vertices each; a
+// binary file is recognised by its size, since its header may begin with
+// "solid" as well
+static vector<array<double, 9>> read_stl(const char *path)
+{
+    vector<char> data = read_file(path);
+    vector<array<double, 9>> triangles;
+
+    uint32_t count = 0;
+    if(data.size() >= 84)
+        memcpy(&count,data.data()+80,sizeof(count));
+    if(data.size() >= 84 && data.size() == 84+50*size_t(count))
+    {
+        // 80 byte header, count, then per triangle the normal, the vertices
+        // as float32 and a 16 bit attribute
+        triangles.resize(count);
+        for(size_t i = 0; i < count; ++i)
+        {
+            float v[9];
+            memcpy(v,data.data()+84+50*i+12,sizeof(v));
+            for(int k = 0; k < 9; ++k)
+                triangles[i][k] = v[k];
+        }
+        return triangles;
+    }
+
+    // ASCII: solid name, then facets of an outer loop of three vertices;
+    // only the vertex lines matter
+    data.push_back('\0');
+    const char *s = strchr(data.data(),'\n');
+    array<double, 9> t;
+    int k = 0;
+    while(s != nullptr && (s = strstr(s,"vertex")) != nullptr)
+    {
+        s += 6;
+        for(int c = 0; c < 3; ++c)
+        {
+            char *end;
+            t[3*k+c] = strtod(s,&end);
+            if(end == s)
+                throw runtime_error(string("Malformed STL file: ")+path);
+            s = end;
+        }
+        if(++k == 3)
+        {
+            triangles.push_back(t);
+            k = 0;
+        }
+    }
+    if(k != 0)
+        throw runtime_error(string("Malformed STL file: ")+path);
+    return triangles;
+}
+
+Voxeliser::Voxeliser(const char *path, double slice, double scale, double offset_x, double offset_y)
+{
+    const vector<array<double, 9>> triangles = read_stl(path);
+    if(triangles.empty())
+        throw runtime_error(string("STL file has no triangles: ")+path);
+    ntriangles = triangles.size();
+
+    double zmin = triangles[0][2], zmax = zmin;
+    for(const array<double, 9> &t : triangles)
+    {
+        for(int k = 0; k < 3; ++k)
+        {
+            zmin = min(zmin,t[3*k+2]);
+            zmax = max(zmax,t[3*k+2]);
+        }
+    }
+    z_plane = zmin+slice*(zmax-zmin);
+
+    // a triangle with vertices on both sides of the plane is cut along two
+    // edges; every edge is interpolated from its lower end, so both triangles
+    // of an edge get the same point and the cross-section stays closed
+    for(const array<double, 9> &t : triangles)
+    {
+        double p[2][2];
+        int n = 0;
+        for(int k = 0; k < 3; ++k)
+        {
+            const double *a = &t[3*k], *b = &t[3*((k+1)%3)];
+            if((a[2] >= z_plane) == (b[2] >= z_plane))
+                continue;
+            if(a[2] > b[2])
+                swap(a,b);
+            const double s = (z_plane-a[2])/(b[2]-a[2]);
+            p[n][0] = scale*(a[0]+s*(b[0]-a[0]))+offset_x;
+            p[n][1] = scale*(a[1]+s*(b[1]-a[1]))+offset_y;
+            ++n;
+        }
+        if(n == 2)
+            segs.push_back({p[0][0],p[0][1],p[1][0],p[1][1]});
+    }
+    if(segs.empty())
+        throw runtime_error(string("The slice plane misses the surface: ")+path);
+
+    nodes.reserve(2*(segs.size()/leaf_size+1));
+    build(0,uint32_t(segs.size()));
+}
+
+uint32_t Voxeliser::build(uint32_t begin, uint32_t end)
+{
+    Box box{segs[begin].x0,segs[begin].y0,segs[begin].x0,segs[begin].y0};
+    for(uint32_t i = begin; i < end; ++i)
+    {
+        const Segment &s = segs[i];
+        box.x0 = min({box.x0,s.x0,s.x1});
+        box.y0 = min({box.y0,s.y0,s.y1});
+        box.x1 = max({box.x1,s.x0,s.x1});
+        box.y1 = max({box.y1,s.y0,s.y1});
+    }
+    const uint32_t i = nodes.size();
+    nodes.push_back({box,begin,end,0});
+    if(end-begin <= leaf_size)
+        return i;
+
+    // split at the median of the centres along the longer side
+    const bool along_x = box.x1-box.x0 >= box.y1-box.y0;
+    const uint32_t mid = begin+(end-begin)/2;
+    nth_element(segs.begin()+begin,segs.begin()+mid,segs.begin()+end,[&](const Segment &a, const Segment &b)
+    {
+        return along_x ? a.x0+a.x1 < b.x0+b.x1 : a.y0+a.y1 < b.y0+b.y1;
+    });
+    build(begin,mid);
+    const uint32_t right = build(mid,end);
+    nodes[i].right = right;
+    return i;
+}
+
+template<class Hit, class Visit>
+void Voxeliser::query(Hit hit, Visit visit) const
+{
+    // the median split keeps the depth below 64 for any count
+    uint32_t stack[64];
+    unsigned int top = 0;
+    stack[top++] = 0;
+    while(top > 0)
+    {
+        const uint32_t i = stack[--top];
+        const Node &n = nodes[i];
+        if(!hit(n.box))
+            continue;
+        if(n.right == 0)
+        {
+            for(uint32_t k = n.begin; k < n.end; ++k)
+                visit(segs[k]);
+            continue;
+        }
+        stack[top++] = n.right;
+        stack[top++] = i+1;
+    }
+}
+
+void Voxeliser::fill(ThreadPool &pool, mdspan<unsigned char, dextents<size_t, 2>> solid) const
+{
+    const size_t NX = solid.extent(0), NY = solid.extent(1);
+    pool.run([&](unsigned int tid)
+    {
+        vector<double> crossings;
+        for(size_t x = pool.begin(tid,NX); x < pool.end(tid,NX); ++x)
+        {
+            // the ray along y through the node centres of column x
+            const double xc = x+0.5;
+            crossings.clear();
+            query([&](const Box &b) { return b.x0 <= xc && xc <= b.x1; },
+                  [&](const Segment &s)
+                  {
+                      if((s.x0 <= xc) != (s.x1 <= xc))
+                          crossings.push_back(s.y0+(xc-s.x0)*(s.y1-s.y0)/(s.x1-s.x0));
+                  });
+            sort(crossings.begin(),crossings.end());
+
+            // the column is contiguous in the mask
+            for(size_t y = 0; y < NY; ++y)
+                solid[x,y] = 0;
+            for(size_t k = 0; k+1 < crossings.size(); k += 2)
+            {
+                // nodes with crossings[k] <= y+0.5 < crossings[k+1]
+                const size_t y0 = size_t(clamp(ceil(crossings[k]-0.5),0.0,double(NY)));
+                const size_t y1 = size_t(clamp(ceil(crossings[k+1]-0.5),0.0,double(NY)));
+                for(size_t y = y0; y < y1; ++y)
+                    solid[x,y] = 1;
+            }
+        }
+    });
+}
+
+vector<WallLink> Voxeliser::links(ThreadPool &pool, mdspan<unsigned char, dextents<size_t, 2>> solid) const
+{
+    const size_t NX = solid.extent(0), NY = solid.extent(1);
+    vector<vector<WallLink>> found(pool.size());
+    pool.run([&](unsigned int tid)
+    {
+        for(size_t x = pool.begin(tid,NX); x < pool.end(tid,NX); ++x)
+        {
+            for(size_t y = 0; y < NY; ++y)
+            {
+                if(solid[x,y])
+                    continue;
+                for(unsigned int d = 1; d < 9; ++d)
+                {
+                    if(!solid[(x+NX+cx[d])%NX,(y+NY+cy[d])%NY])
+                        continue;
+
+                    // first crossing of the link p+t*c, 0 <= t <= 1, with a
+                    // segment a+u*(b-a), 0 <= u <= 1
+                    const double px = x+0.5, py = y+0.5;
+                    const Box link{min(px,px+cx[d]),min(py,py+cy[d]),max(px,px+cx[d]),max(py,py+cy[d])};
+                    double q = 2.0;
+                    query([&](const Box &b) { return b.x0 <= link.x1 && link.x0 <= b.x1 && b.y0 <= link.y1 && link.y0 <= b.y1; },
+                          [&](const Segment &s)
+                          {
+                              const double sx = s.x1-s.x0, sy = s.y1-s.y0;
+                              const double denom = cx[d]*sy-cy[d]*sx;
+                              if(denom == 0.0)
+                                  return;
+                              const double ax = s.x0-px, ay = s.y0-py;
+                              const double t = (ax*sy-ay*sx)/denom;
+                              const double u = (ax*cy[d]-ay*cx[d])/denom;
+                              if(t >= 0.0 && t <= 1.0 && u >= 0.0 && u <= 1.0)
+                                  q = min(q,t);
+                          });
+                    found[tid].push_back({x,y,d,q <= 1.0 ? q : 0.5});
+                }
+            }
+        }
+    });
+
+    // the slabs of x are in thread order
+    vector<WallLink> all;
+    for(const vector<WallLink> &f : found)
+        all.insert(all.end(),f.begin(),f.end());
+    return all;
+}
+
+void write_wall_links(const char *path, const vector<WallLink> &links)
+{
+    FILE *f = fopen(path,"w");
+    if(f == nullptr)
+        throw runtime_error(string("Cannot write wall links to ")+path);
+    fprintf(f,"x,y,direction,q\n");
+    for(const WallLink &l : links)
+        fprintf(f,"%zu,%zu,%u,%.9g\n",l.x,l.y,l.d,l.q);
+    const bool failed = ferror(f) != 0;
+    if(fclose(f) != 0 || failed)
+        throw runtime_error(string("Cannot write wall links to ")+path);
+}
@@ -0,0 +1,86 @@
+#ifndef __VOXEL_H
+#define __VOXEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mdspan>
+#include <vector>
+
+class ThreadPool;
+
+// link from fluid node (x,y) in direction d (1..8) to a solid node; the wall
+// crosses the link at q times its length from the fluid node
+struct WallLink {
+    size_t x, y;
+    unsigned int d;
+    double q;
+};
+
+/**
+ * Voxeliser of a triangulated surface from an STL file.
+ *
+ * The lattice is two dimensional, so the surface is cut by the plane at
+ * slice times its z extent first: every triangle that straddles the plane
+ * gives a segment of the cross-section, mapped to lattice units by scale and
+ * offset (a node (x,y) has its centre at x+0.5, y+0.5). A bounding volume
+ * hierarchy over the segments, split at the median, finds the segments a
+ * ray or a link can cross. fill() casts one ray per column of x through the
+ * node centres, in parallel on the pool, and marks the nodes between pairs
+ * of crossings (parity) straight in the mask; links() collects the links
+ * from fluid to solid nodes with the distance of the wall along each.
+ * Vertices on the plane count as above it, and end points on a ray as to
+ * its right, so closed surfaces give closed cross-sections and every
+ * crossing is counted once.
+ */
+class Voxeliser {
+public:
+    // reads a binary or ASCII STL file; throws if it cannot be read or the
+    // plane misses the surface
+    Voxeliser(const char *path, double slice, double scale, double offset_x, double offset_y);
+
+    size_t triangles() const { return ntriangles; }
+    size_t segments() const { return segs.size(); }
+    double plane() const { return z_plane; }
+
+    // set the nodes inside the cross-section, clear all others
+    void fill(ThreadPool &pool, std::mdspan<unsigned char, std::dextents<size_t, 2>> solid) const;
+
+    // links from fluid to solid nodes of the mask, ordered by x, y and
+    // direction; q is 0.5 where the link crosses no segment, e.g. for solid
+    // nodes that are not from this surface
+    std::vector<WallLink> links(ThreadPool &pool, std::mdspan<unsigned char, std::dextents<size_t, 2>> solid) const;
+
+private:
+    struct Segment {
+        double x0, y0, x1, y1;
+    };
+
+    struct Box {
+        double x0, y0, x1, y1;
+    };
+
+    // the left child follows its parent, leaves have right == 0
+    struct Node {
+        Box box;
+        uint32_t begin, end;    // segments of the subtree
+        uint32_t right;
+    };
+
+    static const uint32_t leaf_size = 4;
+
+    uint32_t build(uint32_t begin, uint32_t end);
+
+    // visit(segment) for the segments in nodes with hit(box)
+    template<class Hit, class Visit>
+    void query(Hit hit, Visit visit) const;
+
+    size_t ntriangles = 0;
+    double z_plane = 0.0;
+    std::vector<Segment> segs;
+    std::vector<Node> nodes;
+};
+
+// write the links as CSV (x,y,direction,q); throws on error
+void write_wall_links(const char *path, const std::vector<WallLink> &links);
+
+#endif /* __VOXEL_H */